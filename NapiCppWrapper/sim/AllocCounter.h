@@ -0,0 +1,75 @@
+//
+//  AllocCounter.h
+//  NapiCpp
+//
+//  Replaces every global operator new and delete with malloc and free, counting the allocations of the
+//  process and of the calling thread, so a case can count its own. Defines the replacements, so include
+//  it in one translation unit of an executable.
+//
+
+#ifndef AllocCounter_h
+#define AllocCounter_h
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+std::atomic<std::uint64_t> allocations{ 0 };
+thread_local std::uint64_t threadAllocations = 0;
+
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocations;
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try { return operator new(size); }
+    catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t size, const std::nothrow_t&) noexcept { return operator new(size, std::nothrow); }
+
+//over-aligned types, from C++17. std::aligned_alloc wants a multiple of the alignment, and is released with free
+#if defined(__cpp_aligned_new)
+void *operator new(std::size_t size, std::align_val_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocations;
+    std::size_t alignment = static_cast<std::size_t>(align);
+    std::size_t rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+    if (void *p = std::aligned_alloc(alignment, rounded)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](std::size_t size, std::align_val_t align) { return operator new(size, align); }
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    try { return operator new(size, align); }
+    catch (...) { return nullptr; }
+}
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return operator new(size, align, std::nothrow); }
+#endif
+
+//gcc matches the inlined free against the operator new at the call site and warns, though the replacements pair up
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t&) noexcept { std::free(p); }
+#if defined(__cpp_aligned_new)
+void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+#endif
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#endif /* AllocCounter_h */
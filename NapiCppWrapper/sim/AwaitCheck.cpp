@@ -0,0 +1,164 @@
+//
+//  AwaitCheck.cpp
+//  NapiCpp
+//
+//  Awaits every operation of NymiProvisionAwaitables.h with both resumers, so that the header is
+//  instantiated by the sim build, then checks against NapiSim that an awaited request resumes on the
+//  executor it was given, and allocates nothing but the coroutine frame on top of the request itself.
+//  Built by sim/CMakeLists.txt when the compiler has coroutines, and run by ctest. Exits with 1 if a check failed.
+//
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "AllocCounter.h"
+#include "NymiApi.h"
+#include "NymiProvisionAwaitables.h"
+#include "NapiSim.h"
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "AwaitCheck.cpp needs a compiler with C++20 coroutines"
+#endif
+
+namespace AwaitCheck {
+
+    //fire and forget coroutine, the frame is destroyed when the body returns
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    template <typename Resumer>
+    Detached awaitAll(NymiProvision prov, Resumer resumer) {
+
+        NapiResult<std::string> random = co_await NymiAwait::getRandom(prov, resumer);
+        NapiResult<std::string> symmetricKey = co_await NymiAwait::getSymmetricKey(prov, resumer);
+        NapiResult<KeyType> createdKey = co_await NymiAwait::createSymmetricKey(prov, false, resumer);
+        NapiResult<EcdsaSignature> signature = co_await NymiAwait::signMessage(prov, random.value, resumer);
+        NapiResult<KeyType> totpKey = co_await NymiAwait::createTotpKey(prov, symmetricKey.value, false, resumer);
+        NapiResult<std::string> totp = co_await NymiAwait::getTotpKey(prov, resumer);
+        NapiResult<TransientNymiBandInfo> info = co_await NymiAwait::getDeviceInfo(prov, resumer);
+        NapiResult<KeyType> revokedKey = co_await NymiAwait::revokeKey(prov, createdKey.value, resumer);
+        NapiResult<bool> revoked = co_await NymiAwait::revokeProvision(prov, false, resumer);
+        (void)signature; (void)totpKey; (void)totp; (void)info; (void)revokedKey; (void)revoked;
+    }
+
+    template Detached awaitAll<NymiAwait::InlineResumer>(NymiProvision, NymiAwait::InlineResumer);
+    template Detached awaitAll<NymiAwait::ExecutorResumer>(NymiProvision, NymiAwait::ExecutorResumer);
+
+    //result of one request, set from the thread that completes it
+    struct Outcome {
+
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool done = false;
+        bool opResult = false;
+        std::thread::id completedOn;
+
+        void set(bool result) {
+            std::lock_guard<std::mutex> lock(mtx);
+            opResult = result;
+            completedOn = std::this_thread::get_id();
+            done = true;
+            cv.notify_all();
+        }
+
+        bool wait() {
+            std::unique_lock<std::mutex> lock(mtx);
+            return cv.wait_for(lock, std::chrono::seconds(5), [this]{ return done; });
+        }
+    };
+
+    template <typename Resumer>
+    Detached awaitRandom(NymiProvision prov, Resumer resumer, Outcome &outcome) {
+
+        NapiResult<std::string> random = co_await NymiAwait::getRandom(prov, resumer);
+        outcome.set(random.opResult && !random.value.empty());
+    }
+
+    //the same request made with a callback, to compare against
+    void callbackRandom(NymiProvision prov, Outcome &outcome) {
+
+        Outcome *result = &outcome;
+        prov.getRandom(randomCallback([result](bool opResult, const std::string&, const std::string &rand, const napiError&) {
+            result->set(opResult && !rand.empty());
+        }));
+    }
+
+    int failures = 0;
+
+    void check(const char *name, bool passed) {
+
+        std::printf("%-52s %s\n", name, passed ? "ok" : "FAILED");
+        if (!passed) ++failures;
+    }
+
+} //end namespace AwaitCheck
+
+int main() {
+
+    using namespace AwaitCheck;
+
+    NapiSimConfig config;
+    config.numBands = 1;
+    config.latencyMedianMs = 1;
+    config.latencyP99Ms = 2;
+    NapiSim::setConfig(config);
+
+    nymi::ConfigOutcome initResult;
+    NymiApi *napi = NymiApi::getNymiApi(initResult, [](const napiError&){}, ".");
+    if (initResult != nymi::ConfigOutcome::okay) {
+        std::printf("NymiApi initialization failed\n");
+        return 1;
+    }
+    NymiProvision band(NapiSim::getPids().at(0));
+
+    //the first requests grow the registry, timer wheel and outbound queue, the measured ones reuse them
+    for (int i = 0; i < 4; ++i) {
+        Outcome warmAwait, warmCallback;
+        awaitRandom(band, NymiAwait::InlineResumer(), warmAwait);
+        callbackRandom(band, warmCallback);
+        warmAwait.wait();
+        warmCallback.wait();
+    }
+
+    //allocations on this thread while issuing: the request path is the same, the coroutine adds its frame
+    Outcome byCallback, byAwait;
+    std::uint64_t before = threadAllocations;
+    callbackRandom(band, byCallback);
+    std::uint64_t callbackAllocs = threadAllocations - before;
+    before = threadAllocations;
+    awaitRandom(band, NymiAwait::InlineResumer(), byAwait);
+    std::uint64_t awaitAllocs = threadAllocations - before;
+
+    check("callback getRandom completes", byCallback.wait() && byCallback.opResult);
+    check("awaited getRandom completes", byAwait.wait() && byAwait.opResult);
+    check("awaiting allocates only the coroutine frame", awaitAllocs == callbackAllocs + 1);
+    if (awaitAllocs != callbackAllocs + 1) {
+        std::printf("    %llu allocations awaiting, %llu with a callback\n", (unsigned long long)awaitAllocs, (unsigned long long)callbackAllocs);
+    }
+
+    //resumed on the executor's one worker, not on the listener thread that received the response
+    {
+        CallbackExecutor executor(1);
+        Outcome worker;
+        executor.post(band.getPid(), [&worker]{ worker.set(true); });
+        worker.wait();
+
+        Outcome onExecutor;
+        awaitRandom(band, NymiAwait::ExecutorResumer{ &executor, &band.getPid() }, onExecutor);
+        check("ExecutorResumer getRandom completes", onExecutor.wait() && onExecutor.opResult);
+        check("ExecutorResumer resumes on the executor", onExecutor.completedOn == worker.completedOn);
+    }
+
+    delete napi;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+//
+//  LoadGen.cpp
+//  NapiCpp
+//
+//  Load generator for the wrapper, built against NapiSim.cpp by sim/CMakeLists.txt. Run it
+//  with e.g.
+//      LoadGen --bands 1000 --mix sign:4,random:4,info:1 --clients 8 --depth 16 --duration 10
+//  and it prints one json object: the options, the throughput, and per operation counts and
+//  p50/p99/p999 latency in us, measured from the request to its callback. With
+//      LoadGen --sweep 10,100,1000,10000 --mix sign:1,random:1 --duration 10
+//  it runs once per band count, each against a fresh NymiApi, and prints one json object per line.
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "json/src/json.hpp"
+#include "NymiApi.h"
+#include "NymiProvision.h"
+#include "LatencyHistogram.h"
+#include "NapiSim.h"
+
+using nljson = nlohmann::json;
+using steadyClock = std::chrono::steady_clock;
+
+enum LoadOp { SIGN, RANDOM, INFO, BUZZ, NUM_LOAD_OPS };
+const char *loadOpNames[NUM_LOAD_OPS] = { "sign", "random", "info", "buzz" };
+
+struct Options {
+    std::size_t bands = 100;
+    std::vector<std::size_t> sweep;     //band counts to run one after another, instead of bands
+    unsigned weights[NUM_LOAD_OPS] = { 1, 1, 0, 0 };
+    unsigned clients = 4;               //threads making requests
+    unsigned depth = 8;                 //requests in flight per client
+    double rate = 0;                    //requests per second over all clients, 0 for as fast as replies come back
+    double durationS = 10;
+    std::uint32_t timeoutMs = 30000;
+    unsigned executorThreads = 0;       //NymiApi::enableCallbackExecutor, 0 to run callbacks on the listener
+    NapiSimConfig sim;
+};
+
+struct OpStats {
+    std::atomic<std::uint64_t> issued{ 0 };     //attempted, whether or not the request could be made
+    std::atomic<std::uint64_t> completed{ 0 };  //callback called, successful or not
+    std::atomic<std::uint64_t> failed{ 0 };
+    std::atomic<std::uint64_t> timedOut{ 0 };
+    LatencyHistogram latency;           //successful requests only
+};
+
+//counts of one run, fresh for each band count of a sweep
+struct RunStats {
+    OpStats ops[NUM_LOAD_OPS];
+    LatencyHistogram all;
+};
+
+//a client waits on its own in-flight count, so one slow client does not hold up the others
+struct Client {
+    std::mutex mtx;
+    std::condition_variable cv;
+    unsigned inFlight = 0;
+    RunStats *run = nullptr;
+};
+
+bool parseMix(const std::string &mix, unsigned weights[NUM_LOAD_OPS]) {
+
+    for (int op = 0; op < NUM_LOAD_OPS; ++op) weights[op] = 0;
+
+    std::istringstream iss(mix);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+
+        std::size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        unsigned weight = colon == std::string::npos ? 1 : (unsigned)std::strtoul(item.c_str() + colon + 1, nullptr, 10);
+
+        int op = 0;
+        while (op < NUM_LOAD_OPS && name != loadOpNames[op]) ++op;
+        if (op == NUM_LOAD_OPS) return false;
+        weights[op] = weight;
+    }
+    return true;
+}
+
+bool parseCounts(const std::string &list, std::vector<std::size_t> &counts) {
+
+    counts.clear();
+
+    std::istringstream iss(list);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        std::size_t count = std::strtoul(item.c_str(), nullptr, 10);
+        if (count == 0) return false;
+        counts.push_back(count);
+    }
+    return !counts.empty();
+}
+
+bool parseOptions(int argc, char *argv[], Options &opt) {
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+
+        std::string name = argv[i];
+        const char *val = argv[i + 1];
+
+        if (name == "--bands") opt.bands = std::strtoul(val, nullptr, 10);
+        else if (name == "--sweep") { if (!parseCounts(val, opt.sweep)) return false; }
+        else if (name == "--mix") { if (!parseMix(val, opt.weights)) return false; }
+        else if (name == "--clients") opt.clients = (unsigned)std::strtoul(val, nullptr, 10);
+        else if (name == "--depth") opt.depth = (unsigned)std::strtoul(val, nullptr, 10);
+        else if (name == "--rate") opt.rate = std::atof(val);
+        else if (name == "--duration") opt.durationS = std::atof(val);
+        else if (name == "--timeout") opt.timeoutMs = (std::uint32_t)std::strtoul(val, nullptr, 10);
+        else if (name == "--executor") opt.executorThreads = (unsigned)std::strtoul(val, nullptr, 10);
+        else if (name == "--latency-median") opt.sim.latencyMedianMs = std::atof(val);
+        else if (name == "--latency-p99") opt.sim.latencyP99Ms = std::atof(val);
+        else if (name == "--error-rate") opt.sim.errorRate = std::atof(val);
+        else if (name == "--drop-rate") opt.sim.dropRate = std::atof(val);
+        else if (name == "--state-change") opt.sim.stateChangeMeanMs = std::atof(val);
+        else if (name == "--seed") opt.sim.seed = std::strtoull(val, nullptr, 10);
+        else return false;
+    }
+    return (argc % 2) == 1 && opt.clients > 0 && opt.depth > 0 && opt.bands > 0;
+}
+
+void finish(Client &client, LoadOp op, steadyClock::time_point issued, bool opResult, const napiError &nErr) {
+
+    std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(steadyClock::now() - issued).count();
+    OpStats &stats = client.run->ops[op];
+    stats.completed.fetch_add(1, std::memory_order_relaxed);
+    if (opResult) {
+        stats.latency.record(us);
+        client.run->all.record(us);
+    }
+    else {
+        stats.failed.fetch_add(1, std::memory_order_relaxed);
+        for (auto &err : nErr.errorList) {
+            if (err.second == "timeout") stats.timedOut.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(client.mtx);
+        --client.inFlight;
+    }
+    client.cv.notify_one();
+}
+
+bool issue(Client &client, LoadOp op, NymiProvision &band) {
+
+    steadyClock::time_point issued = steadyClock::now();
+    Client *c = &client;
+
+    switch (op) {
+        case SIGN:
+            return band.signMessage("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+                                    [c, issued](bool res, const std::string&, const std::string&, const std::string&, const napiError &nErr){ finish(*c, SIGN, issued, res, nErr); });
+        case RANDOM:
+            return band.getRandom([c, issued](bool res, const std::string&, const std::string&, const napiError &nErr){ finish(*c, RANDOM, issued, res, nErr); });
+        case INFO:
+            return band.getDeviceInfo([c, issued](bool res, const std::string&, TransientNymiBandInfo&, const napiError &nErr){ finish(*c, INFO, issued, res, nErr); });
+        case BUZZ:
+            return band.sendNotification(HapticNotification::NOTIFY_POSITIVE,
+                                         [c, issued](bool res, const std::string&, HapticNotification, const napiError &nErr){ finish(*c, BUZZ, issued, res, nErr); });
+        default:
+            return false;
+    }
+}
+
+void runClient(unsigned idx, const Options &opt, const std::vector<NymiProvision> &bands, steadyClock::time_point end, Client &client) {
+
+    std::mt19937_64 rng(opt.sim.seed * 7919 + idx);
+    std::discrete_distribution<int> pickOp(opt.weights, opt.weights + NUM_LOAD_OPS);
+    std::uniform_int_distribution<std::size_t> pickBand(0, bands.size() - 1);
+
+    //open loop: each client sends at rate / clients, still capped at depth in flight
+    steadyClock::duration interval = opt.rate > 0 ? std::chrono::duration_cast<steadyClock::duration>(std::chrono::duration<double>(opt.clients / opt.rate)) : steadyClock::duration::zero();
+    steadyClock::time_point next = steadyClock::now();
+
+    while (steadyClock::now() < end) {
+
+        {
+            std::unique_lock<std::mutex> lock(client.mtx);
+            if (!client.cv.wait_until(lock, end, [&]{ return client.inFlight < opt.depth; })) break;
+            ++client.inFlight;
+        }
+
+        LoadOp op = static_cast<LoadOp>(pickOp(rng));
+        NymiProvision band = bands[pickBand(rng)];
+        client.run->ops[op].issued.fetch_add(1, std::memory_order_relaxed);
+        if (!issue(client, op, band)) {
+            client.run->ops[op].failed.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(client.mtx);
+            --client.inFlight;
+        }
+
+        if (interval > steadyClock::duration::zero()) {
+            next += interval;
+            std::this_thread::sleep_until(next);
+        }
+    }
+}
+
+nljson latencyJson(const LatencyHistogram::Snapshot &snap) {
+
+    nljson j;
+    j["count"] = snap.count;
+    j["meanUs"] = snap.meanUs();
+    j["p50Us"] = snap.percentileUs(50);
+    j["p99Us"] = snap.percentileUs(99);
+    j["p999Us"] = snap.percentileUs(99.9);
+    j["maxUs"] = snap.maxUs;
+    return j;
+}
+
+//one run against a fresh NymiApi over numBands simulated bands. null if NymiApi could not be initialized
+nljson runLoad(const Options &opt, std::size_t numBands) {
+
+    NapiSimConfig simConfig = opt.sim;
+    simConfig.numBands = numBands;
+    NapiSim::setConfig(simConfig);
+
+    nymi::ConfigOutcome initResult;
+    NymiApi *napi = NymiApi::getNymiApi(initResult, [](const napiError&){}, ".");
+    if (initResult != nymi::ConfigOutcome::okay) return nljson();
+    napi->setDefaultRequestTimeout(opt.timeoutMs);
+    if (opt.executorThreads > 0) napi->enableCallbackExecutor(opt.executorThreads);
+
+    //the wrapper counters are process wide, a sweep reports the difference over each run
+    std::uint64_t coalescedBefore = napi->getCoalescedDeviceInfoCount();
+    std::uint64_t expiredBefore = napi->getExpiredRequestCount();
+    PrivateOutbound::OutboundStats outboundBefore = PrivateOutbound::getStats();
+
+    std::vector<NymiProvision> bands;
+    for (const std::string &pid : NapiSim::getPids()) bands.push_back(NymiProvision(pid));
+
+    std::unique_ptr<RunStats> run(new RunStats());
+    std::vector<Client> clients(opt.clients);
+    for (auto &client : clients) client.run = run.get();
+
+    std::vector<std::thread> threads;
+    steadyClock::time_point start = steadyClock::now();
+    steadyClock::time_point end = start + std::chrono::duration_cast<steadyClock::duration>(std::chrono::duration<double>(opt.durationS));
+
+    for (unsigned i = 0; i < opt.clients; ++i) {
+        threads.emplace_back(runClient, i, std::cref(opt), std::cref(bands), end, std::ref(clients[i]));
+    }
+    for (auto &t : threads) t.join();
+
+    //requests still in flight are answered or time out
+    for (auto &client : clients) {
+        std::unique_lock<std::mutex> lock(client.mtx);
+        client.cv.wait_for(lock, std::chrono::milliseconds(opt.timeoutMs + 1000), [&]{ return client.inFlight == 0; });
+    }
+    double elapsedS = std::chrono::duration<double>(steadyClock::now() - start).count();
+
+    nljson report;
+    report["options"]["bands"] = numBands;
+    report["options"]["clients"] = opt.clients;
+    report["options"]["depth"] = opt.depth;
+    report["options"]["rate"] = opt.rate;
+    report["options"]["durationS"] = opt.durationS;
+    report["options"]["executorThreads"] = opt.executorThreads;
+    report["options"]["latencyMedianMs"] = opt.sim.latencyMedianMs;
+    report["options"]["latencyP99Ms"] = opt.sim.latencyP99Ms;
+    report["options"]["errorRate"] = opt.sim.errorRate;
+    report["options"]["dropRate"] = opt.sim.dropRate;
+
+    //attempted counts every request the clients tried to make, completed those whose callback was called,
+    //and opsPerSecond the successful ones only
+    std::uint64_t attempted = 0;
+    std::uint64_t completed = 0;
+    for (int op = 0; op < NUM_LOAD_OPS; ++op) {
+        attempted += run->ops[op].issued.load();
+        completed += run->ops[op].completed.load();
+    }
+    LatencyHistogram::Snapshot all = run->all.snapshot();
+
+    report["elapsedS"] = elapsedS;
+    report["attempted"] = attempted;
+    report["completed"] = completed;
+    report["succeeded"] = all.count;
+    report["attemptedPerSecond"] = attempted / elapsedS;
+    report["completedPerSecond"] = completed / elapsedS;
+    report["opsPerSecond"] = all.count / elapsedS;
+    report["latency"] = latencyJson(all);
+
+    for (int op = 0; op < NUM_LOAD_OPS; ++op) {
+        if (opt.weights[op] == 0) continue;
+        nljson &j = report["ops"][loadOpNames[op]];
+        j["issued"] = run->ops[op].issued.load();
+        j["completed"] = run->ops[op].completed.load();
+        j["failed"] = run->ops[op].failed.load();
+        j["timedOut"] = run->ops[op].timedOut.load();
+        j["latency"] = latencyJson(run->ops[op].latency.snapshot());
+    }
+
+    NapiSimStats simStats = NapiSim::getStats();
+    PrivateOutbound::OutboundStats outbound = PrivateOutbound::getStats();
+    std::uint64_t puts = outbound.putCount - outboundBefore.putCount;
+    report["wrapper"]["coalescedDeviceInfo"] = napi->getCoalescedDeviceInfoCount() - coalescedBefore;
+    report["wrapper"]["expiredRequests"] = napi->getExpiredRequestCount() - expiredBefore;
+    report["wrapper"]["outboundMeanLatencyUs"] = puts ? (outbound.meanLatencyUs * outbound.putCount - outboundBefore.meanLatencyUs * outboundBefore.putCount) / puts : 0.0;
+    report["sim"]["puts"] = simStats.puts;
+    report["sim"]["messages"] = simStats.messages;
+
+    delete napi;
+    return report;
+}
+
+int main(int argc, char *argv[]) {
+
+    Options opt;
+    if (!parseOptions(argc, argv, opt)) {
+        std::cerr << "usage: LoadGen [--bands n | --sweep n,n,...] [--mix sign:w,random:w,info:w,buzz:w] [--clients n] [--depth n]\n"
+                     "               [--rate ops/s] [--duration s] [--timeout ms] [--executor threads] [--latency-median ms]\n"
+                     "               [--latency-p99 ms] [--error-rate p] [--drop-rate p] [--state-change ms] [--seed n]\n";
+        return 2;
+    }
+
+    std::vector<std::size_t> bandCounts = opt.sweep.empty() ? std::vector<std::size_t>{ opt.bands } : opt.sweep;
+    for (std::size_t numBands : bandCounts) {
+
+        nljson report = runLoad(opt, numBands);
+        if (report.is_null()) {
+            std::cerr << "NymiApi initialization failed\n";
+            return 1;
+        }
+        std::cout << report.dump() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,436 @@
+//
+//  MicroBench.cpp
+//  NapiCpp
+//
+//  Time and heap allocations per call of the GenJson builders, the json helpers, pending requests and
+//  the Listener handlers. Built like LoadGen, by sim/CMakeLists.txt.
+//  An optional argument only runs the cases whose name contains it, e.g. MicroBench handleOp.
+//  The "check" cases pass or fail, and MicroBench exits with 1 if one failed; ctest runs MicroBench check.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "GenJson.h"
+#include "Listener.h"
+#include "NymiProvision.h"
+#include "TransientNymiBandInfo.h"
+#include "AllocCounter.h"
+
+const char *filter = nullptr;
+
+//doubles the iterations until a run takes 200ms, like benchpress, then reports that run
+template <typename F>
+void bench(const char *name, F f) {
+
+    if (filter && !std::strstr(name, filter)) return;
+
+    for (std::uint64_t n = 1; ; n *= 2) {
+
+        std::uint64_t allocsBefore = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (std::uint64_t i = 0; i < n; ++i) f();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::uint64_t allocs = allocations.load(std::memory_order_relaxed) - allocsBefore;
+
+        if (elapsed >= std::chrono::milliseconds(200) || n >= (1ull << 30)) {
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count() / n;
+            std::printf("%-44s %12llu %12.1f ns/op %8.1f allocs/op\n", name, (unsigned long long)n, ns, (double)allocs / n);
+            return;
+        }
+    }
+}
+
+//like bench, for cases that use up their input: prepare(i) sets up input i of a batch outside the timed
+//region, then f(i) is timed over the batch. batches are repeated until their calls add up to 200ms
+template <typename Prepare, typename F>
+void benchPrepared(const char *name, std::size_t batch, Prepare prepare, F f) {
+
+    if (filter && !std::strstr(name, filter)) return;
+
+    std::uint64_t n = 0, allocs = 0;
+    std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+    while (elapsed < std::chrono::milliseconds(200) && n < (1ull << 30)) {
+
+        for (std::size_t i = 0; i < batch; ++i) prepare(i);
+
+        std::uint64_t allocsBefore = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < batch; ++i) f(i);
+        elapsed += std::chrono::steady_clock::now() - start;
+        allocs += allocations.load(std::memory_order_relaxed) - allocsBefore;
+        n += batch;
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(elapsed).count() / n;
+    std::printf("%-44s %12llu %12.1f ns/op %8.1f allocs/op\n", name, (unsigned long long)n, ns, (double)allocs / n);
+}
+
+//like bench, with f called n times on each of the threads at once. reports the wall time per call,
+//so with no contention and enough cores ns/op drops in proportion to the threads
+template <typename F>
+void benchThreads(const char *name, unsigned threads, F f) {
+
+    if (filter && !std::strstr(name, filter)) return;
+
+    for (std::uint64_t n = 1; ; n *= 2) {
+
+        std::atomic<unsigned> ready{ 0 };
+        std::atomic<bool> go{ false };
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&]{
+                ready.fetch_add(1);
+                while (!go.load()) std::this_thread::yield();
+                for (std::uint64_t i = 0; i < n; ++i) f();
+            });
+        }
+        while (ready.load() < threads) std::this_thread::yield();
+
+        std::uint64_t allocsBefore = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        go.store(true);
+        for (auto &worker : workers) worker.join();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        std::uint64_t allocs = allocations.load(std::memory_order_relaxed) - allocsBefore;
+
+        std::uint64_t calls = n * threads;
+        if (elapsed >= std::chrono::milliseconds(200) || n >= (1ull << 30)) {
+            double ns = std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+            std::printf("%-44s %12llu %12.1f ns/op %8.1f allocs/op\n", name, (unsigned long long)calls, ns, (double)allocs / calls);
+            return;
+        }
+    }
+}
+
+//a case that passes or fails rather than being timed. main returns 1 if any failed
+int failures = 0;
+
+void check(const char *name, bool passed) {
+
+    if (filter && !std::strstr(name, filter)) return;
+    std::printf("%-44s %12s\n", name, passed ? "ok" : "FAILED");
+    if (!passed) ++failures;
+}
+
+void size(const char *name, std::size_t bytes) {
+
+    if (filter && !std::strstr(name, filter)) return;
+    std::printf("%-44s %12llu bytes\n", name, (unsigned long long)bytes);
+}
+
+const std::string pid = "6f1b2d1c9e0a4b7fa0c35e2d81f4a9b3";
+
+//keeps the optimizer from dropping a result
+volatile std::size_t sink;
+
+const std::size_t handlerBatch = 1024;
+
+//the "parse" case times parsing the message the way the listener does. the handler case times the handler
+//alone: registering the pending exchange and writing its exchange into a copy of the parsed message are
+//done for each batch outside the timed region
+template <typename Callback>
+void benchHandler(const char *name, void (*handler)(nljson &), ExchangeOp op, const std::string &message, Callback callback) {
+
+    std::string parseName = std::string("parse ") + name;
+    bench(parseName.c_str(), [&]{ nljson j = nljson::parse(message); sink = j.size(); });
+
+    NymiProvision band(pid);
+    const nljson parsed = nljson::parse(message);
+    std::vector<nljson> inputs(handlerBatch);
+    benchPrepared(name, handlerBatch, [&](std::size_t i){
+        NymiProvision::PendingExchange pending;
+        pending.pid = &band.getPid();
+        pending.callback = NymiProvision::NeaCallback(callback);
+        pending.issued = std::chrono::steady_clock::now();
+        ExchangeId id = NymiProvision::nymiProvisions.insert(op, std::move(pending));
+
+        inputs[i] = parsed;
+        inputs[i]["exchange"] = id.str();
+    }, [&](std::size_t i){ handler(inputs[i]); });
+}
+
+//as benchHandler, for messages that carry no exchange of ours, so there is nothing to register
+void benchEventHandler(const char *name, void (*handler)(nljson &), const std::string &message) {
+
+    std::string parseName = std::string("parse ") + name;
+    bench(parseName.c_str(), [&]{ nljson j = nljson::parse(message); sink = j.size(); });
+
+    const nljson parsed = nljson::parse(message);
+    std::vector<nljson> inputs(handlerBatch);
+    benchPrepared(name, handlerBatch, [&](std::size_t i){ inputs[i] = parsed; }, [&](std::size_t i){ handler(inputs[i]); });
+}
+
+std::string response(const std::string &path, const std::string &request, const std::string &operation, const std::string &response) {
+    return "{\"path\":\"" + path + "\",\"exchange\":\"\",\"request\":" + request + ",\"operation\":" + operation +
+           ",\"successful\":true,\"response\":" + response + "}";
+}
+
+std::string bandInfo(const std::string &bandPid) {
+    return "{\"found\":\"authenticated\",\"present\":\"yes\",\"RSSI_last\":-52,\"RSSI_smoothed\":-55,\"firmwareVersion\":\"4.1.0\","
+           "\"isProvisioned\":true,\"sinceLastContact\":0.8,\"commandQueue\":[],\"provisioned\":{\"pid\":\"" + bandPid + "\","
+           "\"authenticationWindowRemaining\":3412.5,\"commandsQueued\":0,\"enabledRoamingAuthSetup\":false,\"enabledSigning\":true,"
+           "\"enabledSymmetricKeys\":true,\"enabledTOTP\":false}}";
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc > 1) filter = argv[1];
+
+    PrivateListener::setOnError([](const napiError&){});
+    PrivateListener::setOnAgreement([](const std::vector<std::string>&){});
+
+    const std::string exchange = ExchangeId().str();
+    const std::string hash = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+    const std::string totpKey = "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ";
+    const std::string presenceState = "onPresenceChange";
+
+    //GenJson builders
+    bench("get_init", []{ sink = get_init().size(); });
+    bench("finish", []{ sink = finish().size(); });
+    bench("start_prov", []{ sink = start_prov().size(); });
+    bench("accept_pattern", []{ sink = accept_pattern("+-+-+").size(); });
+    bench("stop_prov", []{ sink = stop_prov().size(); });
+    bench("get_info", [&]{ sink = get_info(exchange).size(); });
+    bench("get_random", [&]{ sink = get_random(pid, exchange).size(); });
+    bench("create_symkey", [&]{ sink = create_symkey(pid, true, exchange).size(); });
+    bench("get_symkey", [&]{ sink = get_symkey(pid, exchange).size(); });
+    bench("sign_msg", [&]{ sink = sign_msg(pid, hash, exchange).size(); });
+    bench("set_totp", [&]{ sink = set_totp(pid, totpKey, false, exchange).size(); });
+    bench("get_totp", [&]{ sink = get_totp(pid, exchange).size(); });
+    bench("notify", [&]{ sink = notify(pid, true, exchange).size(); });
+    bench("enable_notification", [&]{ sink = enable_notification(true, presenceState).size(); });
+    bench("get_state_notifications", []{ sink = get_state_notifications().size(); });
+    bench("revoke_provision", [&]{ sink = revoke_provision(pid, true, exchange).size(); });
+    bench("delete_key", [&]{ sink = delete_key(pid, "symmetric", exchange).size(); });
+
+    //the same builders writing into a buffer that is reused, as the writer thread would
+    std::string out;
+    bench("get_info into buffer", [&]{ get_info(out, exchange); sink = out.size(); });
+    bench("get_random into buffer", [&]{ get_random(out, pid, exchange); sink = out.size(); });
+    bench("create_symkey into buffer", [&]{ create_symkey(out, pid, true, exchange); sink = out.size(); });
+    bench("sign_msg into buffer", [&]{ sign_msg(out, pid, hash, exchange); sink = out.size(); });
+    bench("set_totp into buffer", [&]{ set_totp(out, pid, totpKey, false, exchange); sink = out.size(); });
+    bench("notify into buffer", [&]{ notify(out, pid, true, exchange); sink = out.size(); });
+    bench("enable_notification into buffer", [&]{ enable_notification(out, true, presenceState); sink = out.size(); });
+    bench("delete_key into buffer", [&]{ delete_key(out, pid, "symmetric", exchange); sink = out.size(); });
+
+    //a request in flight, from registering its callback to taking it for the response
+    size("sizeof NymiProvision::NeaCallback", sizeof(NymiProvision::NeaCallback));
+    size("sizeof NymiProvision::PendingExchange", sizeof(NymiProvision::PendingExchange));
+    {
+        NymiProvision band(pid);
+        randomCallback onRandom = [](bool, const std::string&, const std::string&, const napiError&){};
+        bench("NeaCallback from randomCallback", [&]{ NymiProvision::NeaCallback callback(onRandom); sink = sizeof(callback); });
+        bench("insert+take pending exchange", [&]{
+            NymiProvision::PendingExchange pending;
+            pending.pid = &band.getPid();
+            pending.callback = NymiProvision::NeaCallback(onRandom);
+            ExchangeId id = NymiProvision::nymiProvisions.insert(ExchangeOp::RANDOM, std::move(pending));
+            sink = NymiProvision::nymiProvisions.take(id, pending);
+        });
+
+        //the callback fits NeaCallback's inline storage and the registry reuses its slots, so once warmed up a
+        //request in flight costs no heap allocation. MicroBench check fails if that stops being true
+        if (!filter || std::strstr("check insert+take allocates nothing", filter)) {
+            auto insertTake = [&]{
+                NymiProvision::PendingExchange pending;
+                pending.pid = &band.getPid();
+                pending.callback = NymiProvision::NeaCallback(onRandom);
+                ExchangeId id = NymiProvision::nymiProvisions.insert(ExchangeOp::RANDOM, std::move(pending));
+                sink = NymiProvision::nymiProvisions.take(id, pending);
+            };
+            for (int i = 0; i < 1000; ++i) insertTake();
+            std::uint64_t allocsBefore = threadAllocations;
+            for (int i = 0; i < 100000; ++i) insertTake();
+            check("check insert+take allocates nothing", threadAllocations == allocsBefore);
+        }
+
+        //the same from several threads, against a registry with a single lock as the baseline
+        static ExchangeRegistry<NymiProvision::PendingExchange, 1> oneShard;
+        for (unsigned threads : { 2u, 4u, 8u }) {
+            std::string sharded = "insert+take contended " + std::to_string(threads) + " threads";
+            benchThreads(sharded.c_str(), threads, [&]{
+                NymiProvision::PendingExchange pending;
+                pending.pid = &band.getPid();
+                pending.callback = NymiProvision::NeaCallback(onRandom);
+                ExchangeId id = NymiProvision::nymiProvisions.insert(ExchangeOp::RANDOM, std::move(pending));
+                sink = NymiProvision::nymiProvisions.take(id, pending);
+            });
+            std::string single = "insert+take contended 1 shard " + std::to_string(threads) + " threads";
+            benchThreads(single.c_str(), threads, [&]{
+                NymiProvision::PendingExchange pending;
+                pending.pid = &band.getPid();
+                pending.callback = NymiProvision::NeaCallback(onRandom);
+                ExchangeId id = oneShard.insert(ExchangeOp::RANDOM, std::move(pending));
+                sink = oneShard.take(id, pending);
+            });
+        }
+    }
+
+    //1M requests in flight at once, issued from 4 threads: every exchange sent to napi is distinct, parses back
+    //to its id, and takes its own pending exchange exactly once
+    if (!filter || std::strstr("check 1M exchanges distinct", filter)) {
+        NymiProvision band(pid);
+        const unsigned threads = 4;
+        const std::size_t perThread = 250000;
+        std::vector<std::vector<std::string> > issued(threads);
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]{
+                issued[t].reserve(perThread);
+                for (std::size_t i = 0; i < perThread; ++i) {
+                    NymiProvision::PendingExchange pending;
+                    pending.pid = &band.getPid();
+                    ExchangeId id = NymiProvision::nymiProvisions.insert(static_cast<ExchangeOp>(1 + i % 10), std::move(pending));
+                    issued[t].push_back(id.str());
+                }
+            });
+        }
+        for (auto &worker : workers) worker.join();
+
+        std::vector<std::string> exchanges;
+        exchanges.reserve(threads * perThread);
+        for (auto &ids : issued) exchanges.insert(exchanges.end(), ids.begin(), ids.end());
+        issued.clear();
+
+        std::size_t takenOnce = 0, takenTwice = 0;
+        for (const std::string &exchange : exchanges) {
+            ExchangeId id;
+            NymiProvision::PendingExchange pending;
+            if (!ExchangeId::parse(exchange, id)) continue;
+            if (NymiProvision::nymiProvisions.take(id, pending) && pending.pid == &band.getPid()) ++takenOnce;
+            if (NymiProvision::nymiProvisions.take(id, pending)) ++takenTwice;
+        }
+        std::sort(exchanges.begin(), exchanges.end());
+        bool distinct = std::adjacent_find(exchanges.begin(), exchanges.end()) == exchanges.end();
+
+        check("check 1M exchanges distinct", distinct && takenOnce == exchanges.size() && takenTwice == 0 &&
+                                             NymiProvision::nymiProvisions.size() == 0);
+    }
+
+    std::string pidRequest = "{\"pid\":\"" + pid + "\"}";
+    std::string randomResponse = response("random/run", pidRequest, "[\"random\",\"run\"]",
+                                          "{\"pseudoRandomNumber\":\"4c1f0e6a2b9d8c7e5f3a1b0c9d8e7f6a5b4c3d2e1f0a9b8c7d6e5f4a3b2c1d0e\"}");
+
+    //json helpers, on a parsed response
+    {
+        nljson j = nljson::parse(randomResponse);
+        nljson *jval;
+        bench("wellConstructedJson", [&]{ sink = PrivateListener::wellConstructedJson(j); });
+        bench("hasKey response/pseudoRandomNumber", [&]{ sink = hasKey(j, {"response","pseudoRandomNumber"}, jval); });
+        bench("hasKey missing", [&]{ sink = hasKey(j, {"event","kind"}, jval); });
+    }
+    size("sizeof TransientNymiBandInfo", sizeof(TransientNymiBandInfo));
+    {
+        nljson band = nljson::parse(bandInfo(pid));
+        bench("TransientNymiBandInfo decode", [&]{ TransientNymiBandInfo decoded(band); sink = sizeof(decoded); });
+
+        TransientNymiBandInfo info(band);
+        bench("TransientNymiBandInfo getters", [&]{
+            int rssi = 0, queued = 0;
+            double window = 0, sinceContact = 0;
+            bool provisioned = false, enabled = false;
+            FoundStatus found;
+            PresenceStatus present;
+            sink = info.getRssiLast(rssi) + info.getRssiSmoothed(rssi) + info.getFoundState(found) + info.getPresenceState(present) +
+                   info.isProvisioned(provisioned) + info.getSinceLastContact(sinceContact) + info.getAuthenticationWindowRemaining(window) +
+                   info.getNumCommandsQueued(queued) + info.enabledRoamingAuthentication(enabled) + info.enabledSigning(enabled) +
+                   info.enabledSymmetricKeys(enabled) + info.enabledTOTP(enabled);
+        });
+
+        //the pid is held inline, or in the overflow if it is longer than napi's
+        std::string longPid = pid + pid, decodedPid, decodedLongPid;
+        bool hasPid = info.getPid(decodedPid);
+        bool hasLongPid = TransientNymiBandInfo(nljson::parse(bandInfo(longPid))).getPid(decodedLongPid);
+        check("check TransientNymiBandInfo pid", hasPid && decodedPid == pid && hasLongPid && decodedLongPid == longPid &&
+                                                 !TransientNymiBandInfo().getPid(decodedPid));
+    }
+
+    //handlers
+    benchHandler("handleOpRandom", PrivateListener::handleOpRandom, ExchangeOp::RANDOM, randomResponse,
+                 randomCallback([](bool, const std::string&, const std::string&, const napiError&){}));
+
+    benchHandler("handleOpSymmetric get", PrivateListener::handleOpSymmetric, ExchangeOp::GET_SYMMETRIC_KEY,
+                 response("symmetricKey/get", pidRequest, "[\"symmetricKey\",\"get\"]", "{\"key\":\"" + hash + "\"}"),
+                 symmetricKeyCallback([](bool, const std::string&, const std::string&, const napiError&){}));
+
+    benchHandler("handleOpSignature", PrivateListener::handleOpSignature, ExchangeOp::SIGN,
+                 response("sign/run", "{\"pid\":\"" + pid + "\",\"hash\":\"" + hash + "\"}", "[\"sign\",\"run\"]",
+                          "{\"signature\":\"" + hash + hash + "\",\"verificationKey\":\"" + hash + hash + "\"}"),
+                 ecdsaSignCallback([](bool, const std::string&, const std::string&, const std::string&, const napiError&){}));
+
+    benchHandler("handleOpTotp get", PrivateListener::handleOpTotp, ExchangeOp::GET_TOTP,
+                 response("totp/get", pidRequest, "[\"totp\",\"get\"]", "{\"totp\":\"492039\"}"),
+                 totpGetCallback([](bool, const std::string&, const std::string&, const napiError&){}));
+
+    benchHandler("handleOpNotified", PrivateListener::handleOpNotified, ExchangeOp::NOTIFY,
+                 response("buzz/run", "{\"pid\":\"" + pid + "\",\"buzz\":true}", "[\"buzz\",\"run\"]", "{}"),
+                 onNotificationCallback([](bool, const std::string&, HapticNotification, const napiError&){}));
+
+    benchHandler("handleOpRevokeProvision", PrivateListener::handleOpRevokeProvision, ExchangeOp::REVOKE_PROVISION,
+                 response("revoke/run", "{\"pid\":\"" + pid + "\",\"onlyIfAuthenticated\":true}", "[\"revoke\",\"run\"]", "{}"),
+                 onProvisionRevokedCallback([](bool, const std::string&, const napiError&){}));
+
+    benchHandler("handleOpKey", PrivateListener::handleOpKey, ExchangeOp::REVOKE_KEY,
+                 response("key/delete", "{\"pid\":\"" + pid + "\",\"symmetric\":true}", "[\"key\",\"delete\"]", "{\"symmetric\":false}"),
+                 revokedKeyCallback([](bool, const std::string&, KeyType, const napiError&){}));
+
+    benchHandler("handleNapiError", PrivateListener::handleNapiError, ExchangeOp::SIGN,
+                 "{\"path\":\"sign/run\",\"exchange\":\"\",\"request\":{\"pid\":\"" + pid + "\",\"hash\":\"" + hash + "\"},"
+                 "\"operation\":[\"sign\",\"run\"],\"successful\":false,\"errors\":[[\"Nymi Band is not authenticated\",\"notAuthenticated\"]]}",
+                 ecdsaSignCallback([](bool, const std::string&, const std::string&, const std::string&, const napiError&){}));
+
+    {
+        std::string provisions = "[", provisionMap = "{", nymiband = "[";
+        for (int i = 0; i < 10; ++i) {
+            std::string bandPid = pid.substr(0, 30) + std::to_string(10 + i);
+            provisions += (i ? ",\"" : "\"") + bandPid + "\"";
+            provisionMap += (i ? ",\"" : "\"") + bandPid + "\":" + std::to_string(i);
+            nymiband += (i ? "," : "") + bandInfo(bandPid);
+        }
+        std::string infoResponse = response("info/get", "{}", "[\"info\",\"get\"]",
+                                            "{\"provisions\":" + provisions + "],\"provisionsPresent\":" + provisions + "],\"provisionMap\":" + provisionMap +
+                                            "},\"nymiband\":" + nymiband + "]}");
+        benchHandler("handleOpInfo 10 bands", PrivateListener::handleOpInfo, ExchangeOp::DEVICE_INFO, infoResponse,
+                     allDeviceInfoCallback([](bool, std::map<std::string,TransientNymiBandInfo>&, const napiError&){}));
+    }
+
+    //the provisions list of a 10k band fleet. handleOpInfo makes a NymiProvision per pid; the first call interns
+    //the pids, the timed ones find them in PrivateListener::bandHandle's table, without the intern mutex
+    {
+        std::string provisions = "[";
+        for (int i = 0; i < 10000; ++i) {
+            std::string bandPid = pid.substr(0, 27) + std::to_string(10000 + i);
+            provisions += (i ? ",\"" : "\"") + bandPid + "\"";
+        }
+        std::string provisionsResponse = "{\"path\":\"info/get\",\"exchange\":\"provisions\",\"request\":{},\"operation\":[\"info\",\"get\"],"
+                                         "\"successful\":true,\"response\":{\"provisions\":" + provisions + "]}}";
+        std::size_t listed = 0;
+        PrivateListener::setProvisionList([&](const std::vector<NymiProvision> &provisionList){ listed = provisionList.size(); });
+
+        nljson j = nljson::parse(provisionsResponse);
+        PrivateListener::handleOpInfo(j);
+        check("check provisions 10k bands listed", listed == 10000);
+
+        bench("parse provisions 10k bands", [&]{ nljson parsed = nljson::parse(provisionsResponse); sink = parsed.size(); });
+        bench("handleOpInfo provisions 10k bands", [&]{ PrivateListener::handleOpInfo(j); sink = listed; });
+        PrivateListener::setProvisionList(nullptr);
+    }
+
+    std::string presenceEvent = "{\"path\":\"notifications/report/presence-change\",\"exchange\":\"*notifications*\",\"operation\":[\"notifications\",\"report\",\"presence-change\"],"
+                                "\"successful\":true,\"event\":{\"kind\":\"presence-change\",\"pid\":\"" + pid + "\",\"before\":\"likely\",\"after\":\"yes\",\"authenticated\":true}}";
+    benchEventHandler("handleOpApiNotifications presence", PrivateListener::handleOpApiNotifications, presenceEvent);
+
+    std::string patternsEvent = "{\"path\":\"provision/report/patterns\",\"exchange\":\"*provisioning*\",\"operation\":[\"provision\",\"report\",\"patterns\"],"
+                                "\"successful\":true,\"event\":{\"kind\":\"patterns\",\"patterns\":[\"+-+-+\"]}}";
+    benchEventHandler("handleOpProvision patterns", PrivateListener::handleOpProvision, patternsEvent);
+
+    return failures ? 1 : 0;
+}
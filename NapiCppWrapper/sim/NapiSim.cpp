@@ -0,0 +1,467 @@
+//
+//  NapiSim.cpp
+//  NapiCpp
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <random>
+#include "json-napi.h"
+#include "json/src/json.hpp"
+#include "NapiSim.h"
+
+using nljson = nlohmann::json;
+
+namespace NapiSim {
+
+    using steadyClock = std::chrono::steady_clock;
+
+    struct Band {
+        std::string found = "authenticated";
+        std::string present = "yes";
+        bool symmetricKey = false;
+        bool totp = false;
+        steadyClock::time_point busyUntil;      //when the band is done with the requests it was given
+        steadyClock::time_point lastContact;
+    };
+
+    //a message to return from jsonNapiGet once due, or a tick of the found/presence simulation
+    struct Scheduled {
+        steadyClock::time_point due;
+        std::uint64_t order;
+        bool stateChange;
+        std::string message;
+    };
+
+    struct Later {
+        bool operator()(const Scheduled &a, const Scheduled &b) const {
+            return a.due != b.due ? a.due > b.due : a.order > b.order;
+        }
+    };
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    NapiSimConfig config;
+    NapiSimConfig nextConfig;
+    NapiSimStats stats;
+    bool running = false;
+
+    std::mt19937_64 rng;
+    std::map<std::string, Band> bands;
+    std::vector<std::string> pids;              //bands in provisioning order, to pick one at random
+    std::map<std::string, bool> notificationsState;
+    bool provisioning = false;
+    std::string pattern;
+
+    std::priority_queue<Scheduled, std::vector<Scheduled>, Later> scheduled;
+    std::uint64_t nextOrder = 0;
+
+    //the functions below are called with mtx held
+    //----------------------------------------------
+
+    double uniform() {
+        return std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    }
+
+    std::string randomHex(std::size_t bytes) {
+
+        static const char hexDigits[] = "0123456789abcdef";
+        std::string hex(bytes * 2, '0');
+        for (char &c : hex) c = hexDigits[rng() & 0xf];
+        return hex;
+    }
+
+    steadyClock::duration sampleLatency() {
+
+        //z of the 99th percentile of the standard normal
+        double sigma = config.latencyP99Ms > config.latencyMedianMs && config.latencyMedianMs > 0 ? std::log(config.latencyP99Ms / config.latencyMedianMs) / 2.3263 : 0.0;
+        double ms = config.latencyMedianMs * std::exp(sigma * std::normal_distribution<double>(0.0, 1.0)(rng));
+        return std::chrono::microseconds(static_cast<std::int64_t>(std::max(ms, 0.0) * 1000));
+    }
+
+    void schedule(steadyClock::time_point due, std::string message) {
+        scheduled.push(Scheduled{ due, nextOrder++, false, std::move(message) });
+    }
+
+    void scheduleStateChange(steadyClock::time_point now) {
+
+        if (config.stateChangeMeanMs <= 0) return;
+        double ms = std::exponential_distribution<double>(1.0 / config.stateChangeMeanMs)(rng);
+        scheduled.push(Scheduled{ now + std::chrono::microseconds(static_cast<std::int64_t>(ms * 1000)), nextOrder++, true, "" });
+    }
+
+    //napi echoes the path, exchange and request, and splits the path into operation
+    nljson reply(const nljson &request) {
+
+        nljson msg;
+        std::string path = request.value("path", "");
+        msg["path"] = path;
+        msg["exchange"] = request.count("exchange") ? request["exchange"] : nljson("");
+        if (request.count("request")) msg["request"] = request["request"];
+
+        nljson operation = nljson::array();
+        std::size_t from = 0;
+        for (std::size_t to; (to = path.find('/', from)) != std::string::npos; from = to + 1) {
+            operation.push_back(path.substr(from, to - from));
+        }
+        operation.push_back(path.substr(from));
+        msg["operation"] = operation;
+        msg["successful"] = true;
+        msg["response"] = nljson::object();
+        return msg;
+    }
+
+    std::string failure(nljson msg, const std::string &text, const std::string &type) {
+
+        msg.erase("response");
+        msg["successful"] = false;
+        msg["errors"] = nljson::array({ nljson::array({ text, type }) });
+        return msg.dump();
+    }
+
+    std::string event(const std::string &path, nljson ev) {
+
+        nljson request;
+        request["path"] = path;
+        request["exchange"] = path.compare(0, 9, "provision") == 0 ? "*provisioning*" : "*notifications*";
+        nljson msg = reply(request);
+        msg.erase("response");
+        msg["event"] = std::move(ev);
+        return msg.dump();
+    }
+
+    std::string addBand() {
+
+        std::string pid;
+        do { pid = randomHex(16); } while (bands.count(pid));
+        bands[pid].lastContact = steadyClock::now();
+        pids.push_back(pid);
+        return pid;
+    }
+
+    nljson deviceInfo(const std::string &pid, const Band &band, steadyClock::time_point now) {
+
+        nljson info;
+        info["found"] = band.found;
+        info["present"] = band.present;
+        info["RSSI_last"] = band.present == "no" ? -100 : -45 - static_cast<int>(rng() % 30);
+        info["RSSI_smoothed"] = band.present == "no" ? -100 : -50 - static_cast<int>(rng() % 20);
+        info["firmwareVersion"] = "4.1.0";
+        info["isProvisioned"] = true;
+        info["sinceLastContact"] = std::chrono::duration<double>(now - band.lastContact).count();
+        info["commandQueue"] = nljson::array();
+        info["provisioned"]["pid"] = pid;
+        info["provisioned"]["authenticationWindowRemaining"] = band.found == "authenticated" ? 3600.0 : 0.0;
+        info["provisioned"]["commandsQueued"] = 0;
+        info["provisioned"]["enabledRoamingAuthSetup"] = false;
+        info["provisioned"]["enabledSigning"] = true;
+        info["provisioned"]["enabledSymmetricKeys"] = band.symmetricKey;
+        info["provisioned"]["enabledTOTP"] = band.totp;
+        return info;
+    }
+
+    std::string info(const nljson &request, steadyClock::time_point now) {
+
+        nljson msg = reply(request);
+        nljson &response = msg["response"];
+        response["provisions"] = nljson::array();
+        response["provisionsPresent"] = nljson::array();
+        response["provisionMap"] = nljson::object();
+        response["nymiband"] = nljson::array();
+
+        for (const std::string &pid : pids) {
+            const Band &band = bands[pid];
+            response["provisions"].push_back(pid);
+            if (band.present != "no") response["provisionsPresent"].push_back(pid);
+            response["provisionMap"][pid] = response["nymiband"].size();
+            response["nymiband"].push_back(deviceInfo(pid, band, now));
+        }
+        return msg.dump();
+    }
+
+    //a request made on a band. returns false if it is never answered
+    bool bandRequest(const std::string &path, const nljson &request, steadyClock::time_point now, steadyClock::time_point &due, std::string &message) {
+
+        nljson msg = reply(request);
+        std::string pid = request.count("request") && request["request"].count("pid") && request["request"]["pid"].is_string() ? request["request"]["pid"].get<std::string>() : "";
+
+        auto bit = bands.find(pid);
+        if (bit == bands.end()) {
+            due = now + sampleLatency();
+            message = failure(msg, "No provisioned Nymi Band with this pid", "unknownPid");
+            return true;
+        }
+        Band &band = bit->second;
+
+        if (uniform() < config.dropRate) {
+            ++stats.dropsInjected;
+            return false;
+        }
+
+        due = std::max(now, band.busyUntil) + sampleLatency();
+        band.busyUntil = due;
+
+        if (uniform() < config.errorRate) {
+            ++stats.errorsInjected;
+            message = failure(msg, "Simulated failure", "simulated");
+            return true;
+        }
+        if (band.found != "authenticated") {
+            message = failure(msg, "Nymi Band is not authenticated", "notAuthenticated");
+            return true;
+        }
+        band.lastContact = due;
+
+        const nljson &args = request["request"];
+        nljson &response = msg["response"];
+
+        if (path == "random/run") {
+            response["pseudoRandomNumber"] = randomHex(32);
+        }
+        else if (path == "symmetricKey/run") {
+            band.symmetricKey = true;
+        }
+        else if (path == "symmetricKey/get") {
+            if (!band.symmetricKey) { message = failure(msg, "No symmetric key on this Nymi Band", "noKey"); return true; }
+            response["key"] = randomHex(32);
+        }
+        else if (path == "sign/run") {
+            response["signature"] = randomHex(64);
+            response["verificationKey"] = randomHex(64);
+        }
+        else if (path == "totp/run") {
+            band.totp = true;
+        }
+        else if (path == "totp/get") {
+            if (!band.totp) { message = failure(msg, "No totp key on this Nymi Band", "noKey"); return true; }
+            response["totp"] = std::to_string(100000 + rng() % 900000);
+        }
+        else if (path == "buzz/run") {
+        }
+        else if (path == "key/delete") {
+            if (args.value("symmetric", false)) { band.symmetricKey = false; response["symmetric"] = false; }
+            if (args.value("totp", false)) { band.totp = false; response["totp"] = false; }
+        }
+        else if (path == "revoke/run") {
+            bands.erase(bit);
+            pids.erase(std::find(pids.begin(), pids.end(), pid));
+        }
+
+        message = msg.dump();
+        return true;
+    }
+
+    void handle(const nljson &request, steadyClock::time_point now) {
+
+        std::string path = request.value("path", "");
+
+        if (path == "random/run" || path == "symmetricKey/run" || path == "symmetricKey/get" || path == "sign/run" ||
+            path == "totp/run" || path == "totp/get" || path == "buzz/run" || path == "key/delete" || path == "revoke/run") {
+
+            steadyClock::time_point due;
+            std::string message;
+            if (bandRequest(path, request, now, due, message)) schedule(due, std::move(message));
+            return;
+        }
+
+        nljson msg = reply(request);
+
+        if (path == "info/get") {
+            schedule(now + sampleLatency(), info(request, now));
+        }
+        else if (path == "notifications/set") {
+            if (request.count("request") && request["request"].is_object()) {
+                for (auto it = request["request"].begin(); it != request["request"].end(); ++it) {
+                    if (it.value().is_boolean()) notificationsState[it.key()] = it.value();
+                }
+            }
+            msg["response"] = notificationsState;
+            schedule(now, msg.dump());
+        }
+        else if (path == "notifications/get") {
+            msg["response"] = notificationsState;
+            schedule(now, msg.dump());
+        }
+        else if (path == "provision/run/start") {
+            provisioning = true;
+            pattern.clear();
+            for (int i = 0; i < 5; ++i) pattern += (rng() & 1) ? '+' : '-';
+            schedule(now, msg.dump());
+            schedule(now + std::chrono::milliseconds(static_cast<std::int64_t>(config.provisionMs)),
+                     event("provision/report/patterns", nljson{ { "kind", "patterns" }, { "patterns", nljson::array({ pattern }) } }));
+        }
+        else if (path == "provision/pattern") {
+            bool accepted = provisioning && request.count("request") && request["request"].value("pattern", "") == pattern;
+            if (!accepted) {
+                schedule(now, failure(msg, "No such pattern", "badPattern"));
+                return;
+            }
+            schedule(now, msg.dump());
+            nljson ev{ { "kind", "provisioned" } };
+            ev["info"]["pid"] = addBand();
+            schedule(now + std::chrono::milliseconds(static_cast<std::int64_t>(config.provisionMs)), event("provision/report/provisioned", ev));
+        }
+        else if (path == "provision/run/stop") {
+            provisioning = false;
+            schedule(now, msg.dump());
+        }
+        else if (path == "init/get" || path == "finish/run") {
+            schedule(now, msg.dump());
+        }
+        else {
+            schedule(now, failure(msg, "Unknown path " + path, "badRequest"));
+        }
+    }
+
+    //found and presence changes of a random band, reported if the wrapper enabled the notification
+    void changeState(steadyClock::time_point now) {
+
+        scheduleStateChange(now);
+        if (pids.empty()) return;
+
+        const std::string &pid = pids[rng() % pids.size()];
+        Band &band = bands[pid];
+        ++stats.stateChanges;
+
+        std::string presentBefore = band.present;
+        if (uniform() < 0.2) {
+            //the band goes out of range or comes back
+            std::string foundBefore = band.found;
+            band.found = band.found == "authenticated" ? "undetected" : "authenticated";
+            band.present = band.found == "authenticated" ? "yes" : "no";
+            if (notificationsState["onFoundChange"]) {
+                schedule(now, event("notifications/report/found-change", nljson{ { "kind", "found-change" }, { "pid", pid }, { "before", foundBefore }, { "after", band.found } }));
+            }
+        }
+        else if (band.found == "authenticated") {
+            static const char *presence[] = { "yes", "likely", "unlikely" };
+            do { band.present = presence[rng() % 3]; } while (band.present == presentBefore);
+        }
+
+        if (band.present != presentBefore && notificationsState["onPresenceChange"]) {
+            schedule(now, event("notifications/report/presence-change", nljson{ { "kind", "presence-change" }, { "pid", pid }, { "before", presentBefore },
+                                                                              { "after", band.present }, { "authenticated", band.found == "authenticated" } }));
+        }
+    }
+
+    //public
+    //------
+
+    void setConfig(const NapiSimConfig &_config) {
+        std::lock_guard<std::mutex> lock(mtx);
+        nextConfig = _config;
+    }
+
+    NapiSimConfig getConfig() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return nextConfig;
+    }
+
+    std::vector<std::string> getPids() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return pids;
+    }
+
+    NapiSimStats getStats() {
+        std::lock_guard<std::mutex> lock(mtx);
+        NapiSimStats current = stats;
+        current.queued = scheduled.size();
+        return current;
+    }
+
+} //end namespace NapiSim
+
+namespace nymi {
+
+    ConfigOutcome jsonNapiConfigure(std::string /*rootDirectory*/, LogLevel /*log*/, int /*nymulatorPort*/, std::string /*nymulatorHost*/) {
+
+        using namespace NapiSim;
+        std::lock_guard<std::mutex> lock(mtx);
+
+        config = nextConfig;
+        stats = NapiSimStats();
+        rng.seed(config.seed);
+        bands.clear();
+        pids.clear();
+        notificationsState = { { "onFoundChange", false }, { "onPresenceChange", false } };
+        provisioning = false;
+        scheduled = decltype(scheduled)();
+
+        for (std::size_t i = 0; i < config.numBands; ++i) addBand();
+        scheduleStateChange(steadyClock::now());
+        running = true;
+        return ConfigOutcome::okay;
+    }
+
+    PutOutcome jsonNapiPut(std::string json_in) {
+
+        using namespace NapiSim;
+
+        nljson request;
+        try {
+            request = nljson::parse(json_in);
+        }
+        catch (...) {
+            request = nljson::object();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!running) return PutOutcome::napiNotRunning;
+            ++stats.puts;
+            handle(request, steadyClock::now());
+        }
+        cv.notify_one();
+        return PutOutcome::okay;
+    }
+
+    JsonGetOutcome jsonNapiGet(std::string &json, std::atomic<bool> &quit, int timeout) {
+
+        using namespace NapiSim;
+        std::unique_lock<std::mutex> lock(mtx);
+
+        steadyClock::time_point deadline = timeout < 0 ? steadyClock::time_point::max() : steadyClock::now() + std::chrono::milliseconds(timeout);
+        while (true) {
+
+            if (!running) return JsonGetOutcome::napiNotRunning;
+            if (quit.load()) return JsonGetOutcome::quitSignaled;
+
+            steadyClock::time_point now = steadyClock::now();
+            if (!scheduled.empty() && scheduled.top().due <= now) {
+
+                Scheduled item = scheduled.top();
+                scheduled.pop();
+                if (item.stateChange) {
+                    changeState(now);
+                    continue;
+                }
+                json = std::move(item.message);
+                ++stats.messages;
+                return JsonGetOutcome::okay;
+            }
+            if (now >= deadline) return JsonGetOutcome::timedout;
+
+            //quit is not signalled through cv, so it is checked at least every 10ms
+            steadyClock::time_point wakeAt = std::min(deadline, now + std::chrono::milliseconds(10));
+            if (!scheduled.empty()) wakeAt = std::min(wakeAt, scheduled.top().due);
+            cv.wait_until(lock, wakeAt);
+        }
+    }
+
+    void jsonNapiTerminate() {
+
+        using namespace NapiSim;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            running = false;
+            scheduled = decltype(scheduled)();
+        }
+        cv.notify_all();
+    }
+
+} //end namespace nymi
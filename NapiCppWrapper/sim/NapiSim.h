@@ -0,0 +1,62 @@
+//
+//  NapiSim.h
+//  NapiCpp
+//
+//  In-process stand-in for the napi library. Link NapiSim.cpp instead of napi / napi-net to run the
+//  wrapper without bands or a Nymulator: it implements nymi::jsonNapiConfigure, jsonNapiPut, jsonNapiGet
+//  and jsonNapiTerminate over a set of simulated, already provisioned bands.
+//
+
+#ifndef NapiSim_h
+#define NapiSim_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct NapiSimConfig {
+
+    std::size_t numBands = 10;          //provisioned and present when napi is configured
+    std::uint64_t seed = 1;             //same seed, same pids and same sequence of latencies, failures and presence changes
+
+    //time from jsonNapiPut to the response being available to jsonNapiGet, log-normal with this median and
+    //99th percentile. requests on the same band are answered one at a time, as the band would
+    double latencyMedianMs = 40;
+    double latencyP99Ms = 250;
+
+    //failure injection, per request made on a band
+    double errorRate = 0;               //answered with "successful":false and an error
+    double dropRate = 0;                //never answered
+
+    //mean time between found or presence changes of a random band, 0 for none.
+    //reported as notifications once the wrapper enables them
+    double stateChangeMeanMs = 0;
+
+    //time from provision/run/start to the pattern, and from the pattern being accepted to the new band
+    double provisionMs = 500;
+};
+
+struct NapiSimStats {
+
+    std::uint64_t puts = 0;             //jsonNapiPut calls
+    std::uint64_t messages = 0;         //messages returned by jsonNapiGet
+    std::uint64_t errorsInjected = 0;
+    std::uint64_t dropsInjected = 0;
+    std::uint64_t stateChanges = 0;
+    std::size_t queued = 0;             //responses and events not yet due or not yet taken
+};
+
+namespace NapiSim {
+
+    //takes effect at the next jsonNapiConfigure
+    void setConfig(const NapiSimConfig &config);
+    NapiSimConfig getConfig();
+
+    //pids of the provisioned bands
+    std::vector<std::string> getPids();
+
+    NapiSimStats getStats();
+
+} //end namespace NapiSim
+
+#endif /* NapiSim_h */
@@ -0,0 +1,30 @@
+//
+//  json-napi.h
+//  NapiCpp
+//
+//  Declarations of the napi functions, as in the json-napi.h that ships with the Nymi SDK, for
+//  building the wrapper against NapiSim.cpp instead of the napi library. Only on the include
+//  path of the sim build; NEAs keep using the SDK header.
+//
+
+#ifndef json_napi_h
+#define json_napi_h
+
+#include <atomic>
+#include <string>
+
+namespace nymi {
+
+    enum class ConfigOutcome { okay, failedToInit, configurationFileNotFound, configurationFileNotReadable, configurationFileNotParsed, configurationInvalid };
+    enum class JsonGetOutcome { okay, napiNotRunning, quitSignaled, timedout, napiFinished, napiNotInitialized };
+    enum class PutOutcome { okay, napiNotRunning, napiFinished };
+    enum class LogLevel { quiet, normal, info, debug, verbose };
+
+    ConfigOutcome jsonNapiConfigure(std::string rootDirectory, LogLevel log = LogLevel::normal, int nymulatorPort = -1, std::string nymulatorHost = "");
+    PutOutcome jsonNapiPut(std::string json_in);
+    JsonGetOutcome jsonNapiGet(std::string &json, std::atomic<bool> &quit, int timeout);
+    void jsonNapiTerminate();
+
+} //end namespace nymi
+
+#endif /* json_napi_h */
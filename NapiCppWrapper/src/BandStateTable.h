@@ -0,0 +1,140 @@
+//
+//  BandStateTable.h
+//  NapiCpp
+//
+//  Found and presence state of every band, kept up to date by the listener from the
+//  found-change and presence-change notifications, and read by the NEA without a request to napi.
+//
+
+#ifndef BandStateTable_h
+#define BandStateTable_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include "NymiApiEnums.h"
+
+struct BandState {
+
+    FoundStatus found = FoundStatus::ERROR;             //ERROR until a found-change is received
+    PresenceStatus presence = PresenceStatus::ERROR;    //ERROR until a presence-change is received
+    bool authenticated = false;                         //as of the last presence-change
+    std::chrono::steady_clock::time_point lastChange;
+};
+
+/*
+    Bands are indexed by the dense index NymiProvision assigns each pid when interning it.
+    The whole state of a band is packed into one 64 bit word, so a read is a single atomic load:
+    wait-free, and never torn, without the retry loop of a seqlock. Writers update the word with a CAS.
+
+        bits  0-7   FoundStatus
+        bits  8-15  PresenceStatus
+        bit   16    authenticated
+        bit   17    set once any notification was received
+        bits 18-63  time of the last change, in ms of steady_clock
+
+    Words are allocated in segments of 1024 bands that are never freed or moved, so readers
+    need no lock; only allocating a segment takes one.
+ */
+class BandStateTable {
+
+public:
+
+    static const int segmentBits = 10;
+    static const std::uint32_t segmentSize = 1u << segmentBits;
+    static const std::uint32_t maxSegments = 4096;
+
+    BandStateTable() {
+        for (auto &segment : segments) segment.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~BandStateTable() {
+        for (auto &segment : segments) delete[] segment.load(std::memory_order_relaxed);
+    }
+
+    BandStateTable(const BandStateTable&) = delete;
+    BandStateTable &operator=(const BandStateTable&) = delete;
+
+    //returns false if no notification about the band has been received
+    bool get(std::uint32_t idx, BandState &state) const {
+
+        if ((idx >> segmentBits) >= maxSegments) return false;
+        const std::atomic<std::uint64_t> *segment = segments[idx >> segmentBits].load(std::memory_order_acquire);
+        if (segment == nullptr) return false;
+
+        std::uint64_t word = segment[idx & (segmentSize - 1)].load(std::memory_order_acquire);
+        if ((word & knownBit) == 0) return false;
+
+        state.found = static_cast<FoundStatus>(word & 0xff);
+        state.presence = static_cast<PresenceStatus>((word >> 8) & 0xff);
+        state.authenticated = (word & authenticatedBit) != 0;
+        state.lastChange = std::chrono::steady_clock::time_point(std::chrono::milliseconds(word >> timeShift));
+        return true;
+    }
+
+    void setFound(std::uint32_t idx, FoundStatus found, std::chrono::steady_clock::time_point when) {
+
+        update(idx, when, [found](std::uint64_t word) {
+            return (word & ~std::uint64_t(0xff)) | static_cast<std::uint8_t>(found);
+        });
+    }
+
+    void setPresence(std::uint32_t idx, PresenceStatus presence, bool authenticated, std::chrono::steady_clock::time_point when) {
+
+        update(idx, when, [presence, authenticated](std::uint64_t word) {
+            word = (word & ~(std::uint64_t(0xff) << 8 | authenticatedBit)) | std::uint64_t(static_cast<std::uint8_t>(presence)) << 8;
+            return authenticated ? word | authenticatedBit : word;
+        });
+    }
+
+private:
+
+    static const std::uint64_t authenticatedBit = std::uint64_t(1) << 16;
+    static const std::uint64_t knownBit = std::uint64_t(1) << 17;
+    static const int timeShift = 18;
+
+    //a band without notifications yet reports ERROR for both states
+    static std::uint64_t blankWord() {
+        return static_cast<std::uint8_t>(FoundStatus::ERROR) | std::uint64_t(static_cast<std::uint8_t>(PresenceStatus::ERROR)) << 8;
+    }
+
+    template <typename Change>
+    void update(std::uint32_t idx, std::chrono::steady_clock::time_point when, Change change) {
+
+        std::atomic<std::uint64_t> *word = slot(idx);
+        if (word == nullptr) return;
+
+        std::uint64_t ms = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(when.time_since_epoch()).count());
+        std::uint64_t prev = word->load(std::memory_order_relaxed);
+        std::uint64_t next;
+        do {
+            std::uint64_t base = (prev & knownBit) ? prev : blankWord();
+            next = (change(base) & ((std::uint64_t(1) << timeShift) - 1)) | knownBit | ms << timeShift;
+        } while (!word->compare_exchange_weak(prev, next, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    std::atomic<std::uint64_t> *slot(std::uint32_t idx) {
+
+        std::uint32_t segIdx = idx >> segmentBits;
+        if (segIdx >= maxSegments) return nullptr;
+
+        std::atomic<std::uint64_t> *segment = segments[segIdx].load(std::memory_order_acquire);
+        if (segment == nullptr) {
+
+            std::lock_guard<std::mutex> lock(growMtx);
+            segment = segments[segIdx].load(std::memory_order_relaxed);
+            if (segment == nullptr) {
+                segment = new std::atomic<std::uint64_t>[segmentSize];
+                for (std::uint32_t i = 0; i < segmentSize; ++i) segment[i].store(0, std::memory_order_relaxed);
+                segments[segIdx].store(segment, std::memory_order_release);
+            }
+        }
+        return &segment[idx & (segmentSize - 1)];
+    }
+
+    std::mutex growMtx;
+    std::atomic<std::atomic<std::uint64_t>*> segments[maxSegments];
+};
+
+#endif /* BandStateTable_h */
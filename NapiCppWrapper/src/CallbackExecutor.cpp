@@ -0,0 +1,155 @@
+//
+//  CallbackExecutor.cpp
+//  NapiCpp
+//
+
+#include "CallbackExecutor.h"
+
+//index of the worker running on this thread, or -1 on any other thread
+static thread_local int currentWorker = -1;
+
+CallbackExecutor::CallbackExecutor(unsigned numThreads) {
+
+    if (numThreads == 0) numThreads = 1;
+
+    for (unsigned i = 0; i < numThreads; ++i) {
+        workers.emplace_back(new Worker);
+    }
+    for (unsigned i = 0; i < numThreads; ++i) {
+        threads.emplace_back(&CallbackExecutor::run, this, i);
+    }
+}
+
+CallbackExecutor::~CallbackExecutor() {
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMtx);
+        stopping.store(true);
+    }
+    wakeCv.notify_all();
+
+    for (auto &t : threads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+void CallbackExecutor::post(const std::string &strandKey, Task task) {
+
+    Strand *strand;
+    {
+        std::lock_guard<std::mutex> lock(strandsMtx);
+        auto &entry = strands[strandKey];
+        if (!entry) entry.reset(new Strand);
+        strand = entry.get();
+    }
+
+    queued.fetch_add(1, std::memory_order_relaxed);
+
+    bool needsSchedule = false;
+    {
+        std::lock_guard<std::mutex> lock(strand->mtx);
+        strand->tasks.emplace_back(std::move(task), steadyClock::now());
+        if (!strand->scheduled) {
+            strand->scheduled = true;
+            needsSchedule = true;
+        }
+    }
+
+    if (needsSchedule) schedule(strand);
+}
+
+void CallbackExecutor::schedule(Strand *strand) {
+
+    //a worker keeps the strands it reschedules, other threads spread strands round robin
+    unsigned target = currentWorker >= 0 ? (unsigned)currentWorker : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mtx);
+        workers[target]->ready.push_back(strand);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMtx);
+        readyStrands.fetch_add(1);
+    }
+    wakeCv.notify_one();
+}
+
+bool CallbackExecutor::popStrand(unsigned self, Strand *&strand) {
+
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.ready.empty()) {
+            strand = own.ready.front();
+            own.ready.pop_front();
+            readyStrands.fetch_sub(1);
+            return true;
+        }
+    }
+
+    for (std::size_t i = 1; i < workers.size(); ++i) {
+
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.ready.empty()) {
+            strand = victim.ready.back();
+            victim.ready.pop_back();
+            readyStrands.fetch_sub(1);
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void CallbackExecutor::run(unsigned self) {
+
+    currentWorker = (int)self;
+
+    while (true) {
+
+        Strand *strand;
+        if (!popStrand(self, strand)) {
+
+            std::unique_lock<std::mutex> lock(wakeMtx);
+            wakeCv.wait(lock, [this]{ return readyStrands.load() > 0 || stopping.load(); });
+            if (readyStrands.load() == 0 && stopping.load()) break;
+            continue;
+        }
+
+        //one task per turn, then the strand goes to the back of the queue so other bands get a turn
+        Task task;
+        steadyClock::time_point posted;
+        {
+            std::lock_guard<std::mutex> lock(strand->mtx);
+            task = std::move(strand->tasks.front().first);
+            posted = strand->tasks.front().second;
+            strand->tasks.pop_front();
+        }
+
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        queueDelay.record(std::chrono::duration_cast<std::chrono::microseconds>(steadyClock::now() - posted).count());
+        task();
+        executed.fetch_add(1, std::memory_order_relaxed);
+
+        bool reschedule;
+        {
+            std::lock_guard<std::mutex> lock(strand->mtx);
+            reschedule = !strand->tasks.empty();
+            if (!reschedule) strand->scheduled = false;
+        }
+        if (reschedule) schedule(strand);
+    }
+
+    currentWorker = -1;
+}
+
+CallbackExecutor::Stats CallbackExecutor::getStats() const {
+
+    Stats stats;
+    stats.queued = queued.load(std::memory_order_relaxed);
+    stats.executed = executed.load(std::memory_order_relaxed);
+    stats.steals = steals.load(std::memory_order_relaxed);
+    stats.queueDelay = queueDelay.snapshot();
+    return stats;
+}
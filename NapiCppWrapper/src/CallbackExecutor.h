@@ -0,0 +1,90 @@
+//
+//  CallbackExecutor.h
+//  NapiCpp
+//
+//  Thread pool running the handling of napi messages, and so the NEA callbacks,
+//  off the listener thread. Enabled with NymiApi::enableCallbackExecutor.
+//
+
+#ifndef CallbackExecutor_h
+#define CallbackExecutor_h
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "LatencyHistogram.h"
+
+/*
+    Tasks are posted on a strand, named by a key (the pid of the band the message is about).
+    Tasks on the same strand run one at a time in the order they were posted; different strands
+    run in parallel. A strand with work is queued on one worker; idle workers steal strands from
+    the back of the other workers' queues.
+ */
+class CallbackExecutor {
+
+public:
+
+    using Task = std::function<void()>;
+
+    struct Stats {
+        std::size_t queued;                     //posted and not yet started
+        std::uint64_t executed;
+        std::uint64_t steals;
+        LatencyHistogram::Snapshot queueDelay;  //time from post to the task starting
+    };
+
+    explicit CallbackExecutor(unsigned numThreads);
+
+    //runs the tasks already posted, then joins the workers
+    ~CallbackExecutor();
+
+    void post(const std::string &strandKey, Task task);
+
+    Stats getStats() const;
+
+private:
+
+    using steadyClock = std::chrono::steady_clock;
+
+    struct Strand {
+        std::mutex mtx;
+        std::deque<std::pair<Task, steadyClock::time_point> > tasks;
+        bool scheduled = false;     //queued on a worker or running
+    };
+
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Strand*> ready;
+    };
+
+    void schedule(Strand *strand);
+    bool popStrand(unsigned self, Strand *&strand);
+    void run(unsigned self);
+
+    std::mutex strandsMtx;
+    std::unordered_map<std::string, std::unique_ptr<Strand> > strands;
+
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+
+    std::mutex wakeMtx;
+    std::condition_variable wakeCv;
+    std::atomic<std::size_t> readyStrands{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::atomic<unsigned> nextWorker{ 0 };
+
+    std::atomic<std::size_t> queued{ 0 };
+    std::atomic<std::uint64_t> executed{ 0 };
+    std::atomic<std::uint64_t> steals{ 0 };
+    LatencyHistogram queueDelay;
+};
+
+#endif /* CallbackExecutor_h */
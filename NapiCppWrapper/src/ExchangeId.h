@@ -0,0 +1,80 @@
+//
+//  ExchangeId.h
+//  NapiCpp
+//
+//  Identifier sent to napi in the "exchange" field of every request made on a NymiProvision,
+//  and echoed back by napi in the response.
+//
+
+#ifndef ExchangeId_h
+#define ExchangeId_h
+
+#include <cstdint>
+#include <string>
+
+//operation a pending exchange was issued for, so that responses and errors can be routed without parsing the path
+enum class ExchangeOp : std::uint8_t { ERROR = 0, RANDOM, CREATE_SYMMETRIC_KEY, GET_SYMMETRIC_KEY, SIGN, CREATE_TOTP, GET_TOTP, NOTIFY, DEVICE_INFO, REVOKE_KEY, REVOKE_PROVISION };
+
+/*
+    An exchange is encoded as a fixed width string: '#', then in lowercase hex
+    the op (2 digits), the registry slot (8 digits) and the sequence number (16 digits).
+    Sequence numbers are process-wide and monotonic, so two requests never share an exchange.
+    Exchanges not produced by ExchangeId (e.g. "provisions", "*notifications*") fail to parse.
+ */
+struct ExchangeId {
+
+    std::uint64_t seq = 0;
+    ExchangeOp op = ExchangeOp::ERROR;
+    std::uint32_t slot = 0;
+
+    static const std::size_t encodedLength = 1 + 2 + 8 + 16;
+
+    std::string str() const {
+
+        std::string exchange(encodedLength, '#');
+        writeHex(&exchange[1], static_cast<std::uint64_t>(op), 2);
+        writeHex(&exchange[3], slot, 8);
+        writeHex(&exchange[11], seq, 16);
+        return exchange;
+    }
+
+    static bool parse(const std::string &exchange, ExchangeId &id) {
+
+        if (exchange.size() != encodedLength || exchange[0] != '#') return false;
+
+        std::uint64_t op, slot, seq;
+        if (!readHex(&exchange[1], 2, op) || !readHex(&exchange[3], 8, slot) || !readHex(&exchange[11], 16, seq)) return false;
+
+        id.op = static_cast<ExchangeOp>(op);
+        id.slot = static_cast<std::uint32_t>(slot);
+        id.seq = seq;
+        return true;
+    }
+
+private:
+
+    static void writeHex(char *out, std::uint64_t val, int digits) {
+
+        static const char hexDigits[] = "0123456789abcdef";
+        for (int i = digits - 1; i >= 0; --i) {
+            out[i] = hexDigits[val & 0xf];
+            val >>= 4;
+        }
+    }
+
+    static bool readHex(const char *in, int digits, std::uint64_t &val) {
+
+        val = 0;
+        for (int i = 0; i < digits; ++i) {
+            char c = in[i];
+            int nibble;
+            if (c >= '0' && c <= '9') nibble = c - '0';
+            else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+            else return false;
+            val = (val << 4) | nibble;
+        }
+        return true;
+    }
+};
+
+#endif /* ExchangeId_h */
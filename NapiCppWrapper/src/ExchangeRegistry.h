@@ -0,0 +1,120 @@
+//
+//  ExchangeRegistry.h
+//  NapiCpp
+//
+//  Pending <exchange,callback> table shared between the threads issuing
+//  requests to napi and the listener thread receiving the responses.
+//
+
+#ifndef ExchangeRegistry_h
+#define ExchangeRegistry_h
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "ExchangeId.h"
+
+/*
+    The table is split into independently locked shards so that concurrent requests rarely
+    contend on the same mutex. insert hands out the ExchangeId to send to napi; the id names
+    the shard and the slot within it, so take indexes the entry directly, and the sequence
+    number stored in the slot rejects stale or forged ids. A value is handed out at most once.
+ */
+template <typename Value, std::size_t NumShards = 16>
+class ExchangeRegistry {
+
+public:
+
+    ExchangeId insert(ExchangeOp op, Value value) {
+
+        ExchangeId id;
+        id.seq = nextSeq.fetch_add(1, std::memory_order_relaxed);
+        id.op = op;
+
+        //consecutive requests go to consecutive shards
+        std::size_t shardIdx = id.seq % NumShards;
+        Shard &shard = shards[shardIdx];
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        std::uint32_t local;
+        if (shard.freeSlots.empty()) {
+            local = static_cast<std::uint32_t>(shard.slots.size());
+            shard.slots.emplace_back();
+        }
+        else {
+            local = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+        }
+
+        Slot &slot = shard.slots[local];
+        slot.seq = id.seq;
+        slot.op = op;
+        slot.value = std::move(value);
+        ++shard.pending;
+
+        id.slot = static_cast<std::uint32_t>(local * NumShards + shardIdx);
+        return id;
+    }
+
+    //removes the entry for id and moves its value into value. returns false if id is not pending
+    bool take(const ExchangeId &id, Value &value) {
+
+        Shard &shard = shards[id.slot % NumShards];
+        std::uint32_t local = static_cast<std::uint32_t>(id.slot / NumShards);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+
+        if (local >= shard.slots.size()) return false;
+        Slot &slot = shard.slots[local];
+        if (slot.seq == freeSeq || slot.seq != id.seq || slot.op != id.op) return false;
+
+        value = std::move(slot.value);
+        slot.value = Value();
+        slot.seq = freeSeq;
+        shard.freeSlots.push_back(local);
+        --shard.pending;
+        return true;
+    }
+
+    bool erase(const ExchangeId &id) {
+
+        Value discard;
+        return take(id, discard);
+    }
+
+    //approximate when other threads are inserting or taking
+    std::size_t size() {
+
+        std::size_t total = 0;
+        for (auto &shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mtx);
+            total += shard.pending;
+        }
+        return total;
+    }
+
+private:
+
+    //sequence numbers start at 1, 0 marks a free slot
+    static const std::uint64_t freeSeq = 0;
+
+    struct Slot {
+        std::uint64_t seq = freeSeq;
+        ExchangeOp op = ExchangeOp::ERROR;
+        Value value;
+    };
+
+    //each shard on its own cache line, so neighbouring locks don't false-share
+    struct alignas(64) Shard {
+        std::mutex mtx;
+        std::vector<Slot> slots;
+        std::vector<std::uint32_t> freeSlots;
+        std::size_t pending = 0;
+    };
+
+    std::atomic<std::uint64_t> nextSeq{ 1 };
+    std::array<Shard, NumShards> shards;
+};
+
+#endif /* ExchangeRegistry_h */
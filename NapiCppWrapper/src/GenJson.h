@@ -3,164 +3,349 @@
 #ifndef GenJson_hpp
 #define GenJson_hpp
 
+#include <string>
 #include "json/src/json.hpp"
 
 using nljson = nlohmann::json;
 
+/*
+    Requests are written straight into a string instead of being built as an nljson and dumped.
+    The output is byte for byte what nljson::dump() gave: no whitespace, the keys of an object
+    in std::map order (callers write them sorted), and strings escaped as nljson escapes them.
+
+    Each builder comes in two forms: one writing into out, which does not allocate once out has
+    grown to the size of the largest request, and one returning a new string, which writes into
+    a per-thread buffer and allocates only the returned copy.
+ */
+class JsonRequestWriter {
+
+public:
+
+    explicit JsonRequestWriter(std::string &_out) :out(_out), needComma(false) {
+        out.clear();
+        out += '{';
+    }
+
+    JsonRequestWriter &field(const char *key, const std::string &val) {
+        name(key);
+        out += '"';
+        escape(val);
+        out += '"';
+        return *this;
+    }
+
+    JsonRequestWriter &field(const char *key, const char *val) {
+        name(key);
+        out += '"';
+        escape(val);
+        out += '"';
+        return *this;
+    }
+
+    JsonRequestWriter &field(const char *key, bool val) {
+        name(key);
+        out += val ? "true" : "false";
+        return *this;
+    }
+
+    JsonRequestWriter &field(const std::string &key, bool val) {
+        name(key);
+        out += val ? "true" : "false";
+        return *this;
+    }
+
+    JsonRequestWriter &beginObject(const char *key) {
+        name(key);
+        out += '{';
+        needComma = false;
+        return *this;
+    }
+
+    JsonRequestWriter &endObject() {
+        out += '}';
+        needComma = true;
+        return *this;
+    }
+
+    void finish() {
+        out += '}';
+    }
+
+private:
+
+    std::string &out;
+    bool needComma;
+
+    template <typename Key>
+    void name(const Key &key) {
+        if (needComma) out += ',';
+        out += '"';
+        escape(key);
+        out += "\":";
+        needComma = true;
+    }
+
+    //as nlohmann::json::escape_string: the two-character escapes, \u00xx for other control characters, everything else as is
+    void escape(const std::string &s) {
+
+        static const char hexDigits[] = "0123456789abcdef";
+
+        //runs of characters that need no escaping are appended in one go
+        std::size_t run = 0;
+        for (std::size_t i = 0; i < s.size(); ++i) {
+            char c = s[i];
+            if (c != '"' && c != '\\' && !(c >= 0x00 && c <= 0x1f)) continue;
+
+            out.append(s, run, i - run);
+            run = i + 1;
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    out += "\\u00";
+                    out += hexDigits[c >> 4];
+                    out += hexDigits[c & 0x0f];
+            }
+        }
+        out.append(s, run, std::string::npos);
+    }
+
+    void escape(const char *s) {
+        for (; *s; ++s) {
+            if (*s == '"' || *s == '\\' || (*s >= 0x00 && *s <= 0x1f)) {
+                escape(std::string(s));
+                return;
+            }
+            out += *s;
+        }
+    }
+};
+
+//scratch space of the builders returning a string
+inline std::string &requestBuffer() {
+    thread_local std::string buffer;
+    return buffer;
+}
+
+inline void get_init(std::string &out) {
+
+    JsonRequestWriter(out).field("exchange", "*init*").field("path", "init/get").finish();
+}
+
 inline std::string get_init() {
 
-	nljson j;
-    j["path"] = "init/get";
-    j["exchange"] = "*init*";
-	return j.dump();
+    get_init(requestBuffer());
+    return requestBuffer();
+}
+
+inline void finish(std::string &out) {
+
+    JsonRequestWriter(out).field("exchange", "*finish*").field("path", "finish/run").finish();
 }
 
 inline std::string finish() {
 
-	nljson j;
-	j["path"] = "finish/run";
-    j["exchange"] = "*finish*";
-	return j.dump();
+    finish(requestBuffer());
+    return requestBuffer();
+}
+
+inline void start_prov(std::string &out) {
+
+    JsonRequestWriter(out).field("exchange", "*provisioning*").field("path", "provision/run/start").finish();
 }
 
 inline std::string start_prov() {
 
-	nljson j;
-    j["path"] = "provision/run/start";
-	j["exchange"] = "*provisioning*";
-	return j.dump();
+    start_prov(requestBuffer());
+    return requestBuffer();
+}
+
+inline void accept_pattern(std::string &out, const std::string &pattern) {
+
+    JsonRequestWriter(out).field("exchange", "*provisioning*").field("path", "provision/pattern")
+        .beginObject("request").field("action", "accept").field("pattern", pattern).endObject()
+        .finish();
+}
+
+inline std::string accept_pattern(const std::string &pattern) {
+
+    accept_pattern(requestBuffer(), pattern);
+    return requestBuffer();
 }
 
-inline std::string accept_pattern(std::string pattern) {
+inline void stop_prov(std::string &out) {
 
-	nljson j;
-    j["path"] = "provision/pattern";
-	j["exchange"] = "*provisioning*";
-    j["request"]["pattern"]=pattern;
-    j["request"]["action"]="accept";
-	return j.dump();
+    JsonRequestWriter(out).field("exchange", "*provisioning*").field("path", "provision/run/stop").finish();
 }
 
 inline std::string stop_prov() {
 
-	nljson j;
-    j["path"] = "provision/run/stop";
-	j["exchange"] = "*provisioning*";
-	return j.dump();
+    stop_prov(requestBuffer());
+    return requestBuffer();
 }
 
 /* exchange here is expected to be non-empty, as it determines which field of info we are interested in*/
-inline std::string get_info(std::string exchange) {
-    
-	nljson j;
-	j["path"] = "info/get";
-	j["exchange"] = exchange;
-	return j.dump();
+inline void get_info(std::string &out, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "info/get").finish();
+}
+
+inline std::string get_info(const std::string &exchange) {
+
+    get_info(requestBuffer(), exchange);
+    return requestBuffer();
 }
 
-inline std::string get_random(std::string pid, std::string exchange = "") {
-    
-    nljson j;
-    j["path"] = "random/run";
-    j["request"]["pid"] = pid;
-    j["exchange"] = exchange;
-    return j.dump();
+inline void get_random(std::string &out, const std::string &pid, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "random/run")
+        .beginObject("request").field("pid", pid).endObject()
+        .finish();
 }
 
-inline std::string create_symkey(std::string pid, bool guarded, std::string exchange = "") {
-    
-    nljson j;
-    j["path"]="symmetricKey/run";
-    j["request"]["pid"] = pid;
-    j["request"]["guarded"]=guarded;
-    j["exchange"] = exchange;
-    return j.dump();
+inline std::string get_random(const std::string &pid, const std::string &exchange = "") {
+
+    get_random(requestBuffer(), pid, exchange);
+    return requestBuffer();
 }
 
-inline std::string get_symkey(std::string pid, std::string exchange = "") {
+inline void create_symkey(std::string &out, const std::string &pid, bool guarded, const std::string &exchange) {
 
-	nljson j;
-    j["path"]="symmetricKey/get";
-	j["request"]["pid"] = pid;
-	j["exchange"] = exchange;
-	return j.dump();
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "symmetricKey/run")
+        .beginObject("request").field("guarded", guarded).field("pid", pid).endObject()
+        .finish();
 }
 
-inline std::string sign_msg(std::string pid, std::string msghash, std::string exchange = "") {
+inline std::string create_symkey(const std::string &pid, bool guarded, const std::string &exchange = "") {
 
-	nljson j;
-    j["path"]="sign/run";
-    j["request"]["pid"]=pid;
-    j["request"]["hash"]=msghash;
-	j["exchange"] = exchange;
-	return j.dump();
+    create_symkey(requestBuffer(), pid, guarded, exchange);
+    return requestBuffer();
 }
 
-inline std::string set_totp(std::string pid, std::string totpkey, bool guarded, std::string exchange = "") {
+inline void get_symkey(std::string &out, const std::string &pid, const std::string &exchange) {
 
-	nljson j;
-    j["path"]="totp/run";
-	j["request"]["pid"] = pid;
-	j["request"]["key"] = totpkey;
-	j["request"]["guarded"] = guarded;
-	j["exchange"] = exchange;
-	return j.dump();
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "symmetricKey/get")
+        .beginObject("request").field("pid", pid).endObject()
+        .finish();
 }
 
-inline std::string get_totp(std::string pid, std::string exchange = "") {
+inline std::string get_symkey(const std::string &pid, const std::string &exchange = "") {
 
-	nljson j;
-    j["path"]="totp/get";
-	j["request"]["pid"] = pid;
-	j["exchange"] = exchange;
-	return j.dump();
+    get_symkey(requestBuffer(), pid, exchange);
+    return requestBuffer();
 }
 
-inline std::string notify(std::string pid, bool notifyType, std::string exchange = "") {
+inline void sign_msg(std::string &out, const std::string &pid, const std::string &msghash, const std::string &exchange) {
 
-	nljson j;
-    j["path"] = "buzz/run";
-	j["request"]["pid"] = pid;
-	j["request"]["buzz"] = notifyType;
-	j["exchange"] = exchange;
-	return j.dump();
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "sign/run")
+        .beginObject("request").field("hash", msghash).field("pid", pid).endObject()
+        .finish();
 }
 
-inline std::string enable_notification(bool enable, std::string state) {
+inline std::string sign_msg(const std::string &pid, const std::string &msghash, const std::string &exchange = "") {
 
-	nljson j;
-    j["path"] = "notifications/set";
-	j["request"] = { {state, enable} };
-    j["exchange"] = "*notifications*";
-	return j.dump();
+    sign_msg(requestBuffer(), pid, msghash, exchange);
+    return requestBuffer();
+}
+
+inline void set_totp(std::string &out, const std::string &pid, const std::string &totpkey, bool guarded, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "totp/run")
+        .beginObject("request").field("guarded", guarded).field("key", totpkey).field("pid", pid).endObject()
+        .finish();
+}
+
+inline std::string set_totp(const std::string &pid, const std::string &totpkey, bool guarded, const std::string &exchange = "") {
+
+    set_totp(requestBuffer(), pid, totpkey, guarded, exchange);
+    return requestBuffer();
+}
+
+inline void get_totp(std::string &out, const std::string &pid, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "totp/get")
+        .beginObject("request").field("pid", pid).endObject()
+        .finish();
+}
+
+inline std::string get_totp(const std::string &pid, const std::string &exchange = "") {
+
+    get_totp(requestBuffer(), pid, exchange);
+    return requestBuffer();
+}
+
+inline void notify(std::string &out, const std::string &pid, bool notifyType, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "buzz/run")
+        .beginObject("request").field("buzz", notifyType).field("pid", pid).endObject()
+        .finish();
+}
+
+inline std::string notify(const std::string &pid, bool notifyType, const std::string &exchange = "") {
+
+    notify(requestBuffer(), pid, notifyType, exchange);
+    return requestBuffer();
+}
+
+inline void enable_notification(std::string &out, bool enable, const std::string &state) {
+
+    JsonRequestWriter(out).field("exchange", "*notifications*").field("path", "notifications/set")
+        .beginObject("request").field(state, enable).endObject()
+        .finish();
+}
+
+inline std::string enable_notification(bool enable, const std::string &state) {
+
+    enable_notification(requestBuffer(), enable, state);
+    return requestBuffer();
+}
+
+inline void get_state_notifications(std::string &out) {
+
+    JsonRequestWriter(out).field("exchange", "*notifications*").field("path", "notifications/get").finish();
 }
 
 inline std::string get_state_notifications(){
-    
-    nljson j;
-    j["path"] = "notifications/get";
-    j["exchange"] = "*notifications*";
-    return j.dump();
+
+    get_state_notifications(requestBuffer());
+    return requestBuffer();
+}
+
+inline void revoke_provision(std::string &out, const std::string &pid, bool only_if_authenticated, const std::string &exchange) {
+
+    JsonRequestWriter(out).field("exchange", exchange).field("path", "revoke/run")
+        .beginObject("request").field("onlyIfAuthenticated", only_if_authenticated).field("pid", pid).endObject()
+        .finish();
 }
 
-inline std::string revoke_provision(std::string pid, bool only_if_authenticated, std::string exchange = "") {
+inline std::string revoke_provision(const std::string &pid, bool only_if_authenticated, const std::string &exchange = "") {
+
+    revoke_provision(requestBuffer(), pid, only_if_authenticated, exchange);
+    return requestBuffer();
+}
+
+inline void delete_key(std::string &out, const std::string &pid, const std::string &key_to_delete, const std::string &exchange) {
+
+    JsonRequestWriter writer(out);
+    writer.field("exchange", exchange).field("path", "key/delete").beginObject("request");
+
+    //the key is the caller's, so its place relative to "pid" is only known here
+    if (key_to_delete == "pid") writer.field("pid", true);
+    else if (key_to_delete < "pid") writer.field(key_to_delete, true).field("pid", pid);
+    else writer.field("pid", pid).field(key_to_delete, true);
 
-    nljson j;
-    j["path"] = "revoke/run";
-    j["request"]["pid"] = pid;
-    j["request"]["onlyIfAuthenticated"] = only_if_authenticated;
-    j["exchange"] = exchange;
-    return j.dump();
+    writer.endObject().finish();
 }
 
-inline std::string delete_key(std::string pid, std::string key_to_delete, std::string exchange = "") {
+inline std::string delete_key(const std::string &pid, const std::string &key_to_delete, const std::string &exchange = "") {
 
-    nljson j;
-    j["path"]="key/delete";
-    j["request"]["pid"]=pid;
-    j["request"][key_to_delete]=true;
-    j["exchange"]= exchange;
-    return j.dump();
+    delete_key(requestBuffer(), pid, key_to_delete, exchange);
+    return requestBuffer();
 }
 
-#endif /* GenJson */
\ No newline at end of file
+#endif /* GenJson */
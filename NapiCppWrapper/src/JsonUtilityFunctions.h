@@ -9,30 +9,47 @@
 #ifndef JsonUtilityFunctions_h
 #define JsonUtilityFunctions_h
 
-#include <vector>
+#include <initializer_list>
+#include <string>
 #include "json/src/json.hpp"
 
 using nljson = nlohmann::json;
 
-inline bool hasKey(nljson &jobj, std::vector<std::string> keyPath, nljson::iterator &jit) {
+//a path of keys into nested json objects, e.g. {"response","pseudoRandomNumber"}.
+//it points at the string literals it is written with, so making one copies and allocates nothing
+using JsonKeyPath = std::initializer_list<const char*>;
 
-    auto keyIt = keyPath.begin();
-    jit = jobj.find(*keyIt++);
-    if (jit == jobj.end()) return false;
+//nljson::find takes its key as a std::string by value, which allocates for keys too long for the small
+//string buffer. hasKey looks keys up in the object's std::map itself, through this per-thread key that
+//keeps its capacity
+inline std::string &jsonKeyBuffer() {
+    thread_local std::string key;
+    return key;
+}
+
+//val is set to the value at keyPath, if every key on the path is found
+inline bool hasKey(nljson &jobj, JsonKeyPath keyPath, nljson *&val) {
+
+    std::string &key = jsonKeyBuffer();
+    val = &jobj;
+    for (const char *k : keyPath) {
 
-    if (keyIt != keyPath.end()){
+        nljson::object_t *object = val->get_ptr<nljson::object_t*>();
+        if (object == nullptr) return false;
 
-        std::vector<std::string> subPath(keyIt++,keyPath.end());
-        return hasKey(jit.value(),subPath,jit);
+        key.assign(k);
+        auto it = object->find(key);
+        if (it == object->end()) return false;
+        val = &it->second;
     }
-    else return true;
+    return true;
 }
 
-inline bool isKeyValue(nljson &jobj, std::vector<std::string> keyPath, nljson::iterator &jit, bool val) {
+inline bool isKeyValue(nljson &jobj, JsonKeyPath keyPath, nljson *&val, bool expected) {
 
-    if (hasKey(jobj,keyPath,jit)){
-        bool valFromJson = jit.value();
-        if (valFromJson == val){
+    if (hasKey(jobj,keyPath,val)){
+        bool valFromJson = *val;
+        if (valFromJson == expected){
             return true;
         }
     }
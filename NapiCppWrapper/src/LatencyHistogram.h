@@ -0,0 +1,107 @@
+//
+//  LatencyHistogram.h
+//  NapiCpp
+//
+//  Lock-free latency histogram, recorded from the wrapper threads and read by the NEA.
+//
+
+#ifndef LatencyHistogram_h
+#define LatencyHistogram_h
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/*
+    Values are in microseconds. Values below 16 get a bucket each; above that, every power of two
+    is split into 16 linear sub-buckets, so a bucket is never wider than 1/16 of its lower bound.
+    Values past the last bucket (about 2^40 us) are counted in the last bucket.
+ */
+class LatencyHistogram {
+
+public:
+
+    static const int subBucketBits = 4;
+    static const int subBucketCount = 1 << subBucketBits;
+    static const int maxExponent = 40;
+    static const int numBuckets = subBucketCount + (maxExponent - subBucketBits) * subBucketCount;
+
+    struct Snapshot {
+
+        std::uint64_t count = 0;
+        std::uint64_t sumUs = 0;
+        std::uint64_t maxUs = 0;
+        std::vector<std::uint64_t> buckets;
+
+        double meanUs() const { return count ? (double)sumUs / count : 0.0; }
+
+        //lower bound of the bucket holding the value at percentile p (0-100)
+        std::uint64_t percentileUs(double p) const {
+
+            if (count == 0) return 0;
+            std::uint64_t rank = (std::uint64_t)(p / 100.0 * (count - 1)) + 1;
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < buckets.size(); ++i) {
+                seen += buckets[i];
+                if (seen >= rank) return bucketLowerBound((int)i);
+            }
+            return maxUs;
+        }
+    };
+
+    LatencyHistogram() {
+        for (auto &b : buckets) b.store(0, std::memory_order_relaxed);
+    }
+
+    void record(std::uint64_t us) {
+
+        buckets[bucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        sumUs.fetch_add(us, std::memory_order_relaxed);
+
+        std::uint64_t prevMax = maxUs.load(std::memory_order_relaxed);
+        while (us > prevMax && !maxUs.compare_exchange_weak(prevMax, us, std::memory_order_relaxed)) {}
+    }
+
+    //buckets are read one at a time, so a snapshot taken while recording may be off by the values in flight
+    Snapshot snapshot() const {
+
+        Snapshot snap;
+        snap.count = count.load(std::memory_order_relaxed);
+        snap.sumUs = sumUs.load(std::memory_order_relaxed);
+        snap.maxUs = maxUs.load(std::memory_order_relaxed);
+        snap.buckets.resize(numBuckets);
+        for (int i = 0; i < numBuckets; ++i) snap.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        return snap;
+    }
+
+    static int bucketIndex(std::uint64_t us) {
+
+        if (us < (std::uint64_t)subBucketCount) return (int)us;
+
+        int msb = subBucketBits;
+        while ((us >> (msb + 1)) != 0) ++msb;
+        if (msb >= maxExponent) return numBuckets - 1;
+
+        int sub = (int)((us >> (msb - subBucketBits)) & (subBucketCount - 1));
+        return subBucketCount + (msb - subBucketBits) * subBucketCount + sub;
+    }
+
+    static std::uint64_t bucketLowerBound(int idx) {
+
+        if (idx < subBucketCount) return (std::uint64_t)idx;
+
+        int msb = subBucketBits + (idx - subBucketCount) / subBucketCount;
+        int sub = (idx - subBucketCount) % subBucketCount;
+        return (std::uint64_t)(subBucketCount + sub) << (msb - subBucketBits);
+    }
+
+private:
+
+    std::atomic<std::uint64_t> buckets[numBuckets];
+    std::atomic<std::uint64_t> count{ 0 };
+    std::atomic<std::uint64_t> sumUs{ 0 };
+    std::atomic<std::uint64_t> maxUs{ 0 };
+};
+
+#endif /* LatencyHistogram_h */
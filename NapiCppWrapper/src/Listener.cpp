@@ -6,18 +6,27 @@
 //  Copyright © 2016 Hanieh Bastani. All rights reserved.
 //
 
+#include <algorithm>
+#include <chrono>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
+#include <unordered_map>
 #include "Listener.h"
 #include "json-napi.h"
 #include "NymiProvision.h"
 #include "TransientNymiBandInfo.h"
+#include "WrapperLog.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include "Recording.h"
 
 namespace PrivateListener {
 
     const bool success = true;
     const bool failure = false;
     const napiError noErr = { "", {} };
+    const std::string noString;
     
     //variables, and their getters and setters
     std::atomic<bool> quit{ false };
@@ -25,6 +34,56 @@ namespace PrivateListener {
         quit.store(_quit);
     }
 
+    //jsonNapiGet timeout, adapted between the two bounds depending on traffic
+    std::atomic<int> minPollMs{ 10 };
+    std::atomic<int> maxPollMs{ 250 };
+    void setPollInterval(int _minPollMs, int _maxPollMs) {
+        minPollMs.store(_minPollMs);
+        maxPollMs.store(_maxPollMs);
+    }
+    
+    std::atomic<CallbackExecutor*> callbackExecutor{ nullptr };
+    void setCallbackExecutor(CallbackExecutor *_callbackExecutor) {
+        callbackExecutor.store(_callbackExecutor);
+    }
+    
+    std::atomic<std::uint64_t> expiredCount{ 0 };
+    std::uint64_t getExpiredCount() {
+        return expiredCount.load(std::memory_order_relaxed);
+    }
+    
+    //handles of the bands named in notifications and provision lists, so that the intern mutex is only taken
+    //the first time a pid is seen. with a callback executor the handlers run on its workers, hence knownBandsMtx,
+    //which unlike the intern mutex is only shared by the handlers
+    std::mutex knownBandsMtx;
+    std::unordered_map<std::string, NymiProvision> knownBands;
+    NymiProvision bandHandle(const std::string &pid) {
+        std::lock_guard<std::mutex> lock(knownBandsMtx);
+        auto it = knownBands.find(pid);
+        if (it == knownBands.end()) it = knownBands.emplace(pid, NymiProvision(pid)).first;
+        return it->second;
+    }
+    
+    NotificationBus bandNotifications;
+    NotificationBus &getNotificationBus() {
+        return bandNotifications;
+    }
+    
+    //request answered by the message being handled on this thread. its latency is recorded once
+    //the handler, and so the NEA callback, returns
+    struct Completion {
+        bool taken = false;
+        ExchangeOp op = ExchangeOp::ERROR;
+        std::uint64_t seq = 0;
+        std::chrono::steady_clock::time_point issued;
+    };
+    thread_local Completion completion;
+    
+    LatencyHistogram dispatchLatency;
+    LatencyHistogram::Snapshot getDispatchLatency() {
+        return dispatchLatency.snapshot();
+    }
+
     std::mutex finishMtx;
     std::condition_variable finishCv;
     std::mutex* getFinishMtx(){ return &finishMtx; }
@@ -53,42 +112,152 @@ namespace PrivateListener {
     void setOnNotificationsGet(onNotificationsGetState _onNotificationGet){ onNotificationsGet = _onNotificationGet; }
         
 
+    //the wait for the next message ends no later than the next request deadline, so it fires on time (to the
+    //TimerWheel tick) when napi is idle, not up to maxPollMs late
+    int pollTimeout(int timeoutMs) {
+
+        auto next = NymiProvision::deadlines.nextDeadline();
+        if (next == std::chrono::steady_clock::time_point::max()) return timeoutMs;
+
+        auto untilNext = std::chrono::duration_cast<std::chrono::milliseconds>(next - std::chrono::steady_clock::now()).count() + 1;
+        return static_cast<int>(std::max<decltype(untilNext)>(1, std::min<decltype(untilNext)>(timeoutMs, untilNext)));
+    }
+
+    //tasks handed to the listener thread, run between two messages
+    std::mutex tasksMtx;
+    std::vector<std::function<void()> > tasks;
+    std::atomic<bool> tasksPending{ false };
+    bool listening = false;     //guarded by tasksMtx
+    
+    bool runOnListener(std::function<void()> task) {
+        
+        std::lock_guard<std::mutex> lock(tasksMtx);
+        if (!listening) return false;
+        tasks.push_back(std::move(task));
+        tasksPending.store(true);
+        return true;
+    }
+    
+    void runTasks() {
+        
+        if (!tasksPending.load()) return;
+        
+        std::vector<std::function<void()> > run;
+        {
+            std::lock_guard<std::mutex> lock(tasksMtx);
+            run.swap(tasks);
+            tasksPending.store(false);
+        }
+        for (auto &task : run) task();
+    }
+    
     void waitForMessage() {
         
+        int timeoutMs = minPollMs.load();
+        std::vector<ExchangeId> expired;
+        {
+            std::lock_guard<std::mutex> lock(tasksMtx);
+            listening = true;
+        }
+        
         while (!quit.load()) {
-            //this is a blocking call. Returns only if napi has sent a message, or quit is set to true
+            //this is a blocking call. Returns only if napi has sent a message, quit is set to true, or timeoutMs elapsed
             std::string message;
-            nymi::JsonGetOutcome res = nymi::jsonNapiGet(message,quit,50);
+            nymi::JsonGetOutcome res = nymi::jsonNapiGet(message,quit,pollTimeout(timeoutMs));
 
             if (res == nymi::JsonGetOutcome::okay) {
-                std::cout << "received message: " << message << std::endl;
                 
-                nljson jobj = nljson::parse(message);
+                auto received = std::chrono::steady_clock::now();
+                if (PrivateRecord::enabled()) PrivateRecord::record(PrivateRecord::Direction::INBOUND, message, received);
+                dispatchMessage(message,received);
+                dispatchLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - received).count());
                 
-                if (!wellConstructedJson(jobj)){
-                    return;
-                }
-                
-                //handle any errors
-                nljson::iterator jit;
-                if (hasKey(jobj,{"errors"},jit) || isKeyValue(jobj,{"successful"},jit,false)){
-                    
-                    handleNapiError(jobj);
-                    continue;
-                }
-                
-                //delegate to proper op handler
-                if (hasKey(jobj,{"operation"},jit)) {
-                    
-                    std::string operation = jit.value()[0];
-                    
-                    //call operation handler for this operation
-                    opHandlerType::const_iterator oit;
-                    if ((oit = opHandler.find(operation)) != opHandler.end()) {
-                        oit->second(jobj);	//call the function for this operation
-                    }
-                }
+                //more messages are likely to follow, poll at the short interval
+                timeoutMs = minPollMs.load();
+            }
+            else {
+                //idle, back off towards the long interval
+                timeoutMs = std::min(timeoutMs * 2, maxPollMs.load());
             }
+            
+            //deadlines are checked after every message, and when the wait for the next one is cut short by a deadline
+            expireRequests(expired);
+            runTasks();
+        }
+        
+        //tasks handed over before this point still run, later ones are refused
+        {
+            std::lock_guard<std::mutex> lock(tasksMtx);
+            listening = false;
+        }
+        tasksPending.store(true);
+        runTasks();
+    }
+    
+    void dispatchMessage(const std::string &message, std::chrono::steady_clock::time_point received) {
+        
+        NAPICPP_LOG(WrapperLogLevel::debug, "received message: " << message);
+        
+        nljson jobj = nljson::parse(message);
+        
+        if (PrivateTrace::enabled()) {
+            //only responses to NymiProvision requests belong to a traced exchange
+            std::string exchange;
+            ExchangeId id;
+            if (getExchange(jobj,exchange,false) && ExchangeId::parse(exchange,id)) {
+                PrivateTrace::step(id.seq,"received",received);
+                PrivateTrace::span("parse",id.seq,received,std::chrono::steady_clock::now());
+            }
+        }
+        
+        if (!wellConstructedJson(jobj)){
+            return;
+        }
+        
+        CallbackExecutor *executor = callbackExecutor.load();
+        if (executor == nullptr) {
+            handleMessage(jobj);
+            return;
+        }
+        
+        //messages about the same band are handled in order, messages about different bands in parallel
+        std::string pid;
+        nljson *jval;
+        if (!getPid(jobj,pid) && hasKey(jobj,{"event","pid"},jval) && jval->is_string()) {
+            pid = *jval;
+        }
+        auto shared = std::make_shared<nljson>(std::move(jobj));
+        executor->post(pid, [shared]{ handleMessage(*shared); });
+    }
+    
+    void handleMessage(nljson &jobj) {
+        
+        completion.taken = false;
+        const char *outcome = "ok";
+        
+        //handle any errors
+        nljson *jval;
+        if (hasKey(jobj,{"errors"},jval) || isKeyValue(jobj,{"successful"},jval,false)){
+            
+            outcome = "error";
+            handleNapiError(jobj);
+        }
+        //delegate to proper op handler
+        else if (hasKey(jobj,{"operation"},jval)) {
+            
+            const std::string &operation = (*jval)[0].get_ref<const std::string&>();
+            
+            //call operation handler for this operation
+            opHandlerType::const_iterator oit;
+            if ((oit = opHandler.find(operation)) != opHandler.end()) {
+                oit->second(jobj);	//call the function for this operation
+            }
+        }
+        
+        if (completion.taken) {
+            completion.taken = false;
+            PrivateMetrics::recordLatency(completion.op, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - completion.issued).count());
+            if (PrivateTrace::enabled()) PrivateTrace::end(completion.seq,completion.op,outcome);
         }
     }
 
@@ -98,8 +267,8 @@ namespace PrivateListener {
         
         exchange = "";  //reset
         
-        nljson::iterator jit;
-        if (!hasKey(jobj, {"exchange"}, jit)){
+        nljson *jval;
+        if (!hasKey(jobj, {"exchange"}, jval)){
             if (errorIfNoExchange) {
                 std::string errMsg = "Could not find JSON field \"exchange\" in the JSON obj:\n";
                 errMsg += jobj.dump();
@@ -109,7 +278,7 @@ namespace PrivateListener {
             return false;
         }
         
-        exchange = jit.value();
+        exchange = *jval;
         return true;
     }
     
@@ -117,9 +286,9 @@ namespace PrivateListener {
         
         pid = "";  //reset
         
-        nljson::iterator jit;
-        if (hasKey(jobj, {"request","pid"}, jit)){
-            pid = jit.value();
+        nljson *jval;
+        if (hasKey(jobj, {"request","pid"}, jval)){
+            pid = *jval;
             return true;
         }
         
@@ -138,6 +307,54 @@ namespace PrivateListener {
         return true;
     }
     
+    bool getPid(nljson &jobj, const std::string *&pid){
+        
+        pid = &noString;  //reset
+        
+        nljson *jval;
+        if (hasKey(jobj, {"request","pid"}, jval)){
+            pid = &jval->get_ref<const std::string&>();
+            return true;
+        }
+        
+        return false;
+    }
+    
+    bool getPid(nljson &jobj, const std::string *&pid, napiError &nErr){
+        
+        if (!getPid(jobj,pid)){
+        
+            std::string errMsg = "Could not find JSON field \"pid\" in the JSON obj:\n";
+            errMsg += jobj.dump();
+            nErr = { errMsg, {} };
+            return false;
+        }
+        return true;
+    }
+    
+    bool takePendingExchange(const std::string &exchange, NymiProvision::PendingExchange &pending, ExchangeOp &op){
+        
+        ExchangeId id;
+        if (!ExchangeId::parse(exchange,id)) return false;
+        
+        op = id.op;
+        if (!NymiProvision::nymiProvisions.take(id,pending)) return false;
+        
+        NymiProvision::deadlines.cancel(id);
+        completion.taken = true;
+        completion.op = id.op;
+        completion.issued = pending.issued;
+        completion.seq = id.seq;
+        if (PrivateTrace::enabled()) PrivateTrace::step(id.seq,"handler",std::chrono::steady_clock::now());
+        return true;
+    }
+    
+    bool takePendingExchange(const std::string &exchange, NymiProvision::PendingExchange &pending){
+        
+        ExchangeOp op;
+        return takePendingExchange(exchange,pending,op);
+    }
+    
     napiError genMissingJsonKeyErr(std::string key, nljson &jobj){
         
         std::string errMsg = "Could not find JSON field \"" + key + "\" in the JSON obj:\n";
@@ -151,23 +368,22 @@ namespace PrivateListener {
     //------------------
     void handleNapiError(nljson &jobj) {
         
-        nljson::iterator jit;
+        nljson *jval;
         std::string opVal;
         napiError nErr {"ERROR.",{} };
         //error message specifies the operation
-        if (hasKey(jobj, {"path"}, jit)) {
-            opVal = jit.value();
+        if (hasKey(jobj, {"path"}, jval)) {
+            opVal = *jval;
             nErr.errorString += " Operation: " + opVal;
         }
         
         //extract the array of errors
-        if (hasKey(jobj, {"errors"}, jit)) {
-            auto errorsList = jit.value();
-            std::vector<std::pair<std::string, std::string> > errorsList1;
+        if (hasKey(jobj, {"errors"}, jval)) {
+            auto &errorsList = *jval;
             nErr.errorString += ", Error message(s):";
-            for (auto errPair : errorsList){
-                std::string errType = errPair[1];
-                std::string errMsg = errPair[0];
+            for (auto &errPair : errorsList){
+                const std::string &errType = errPair[1].get_ref<const std::string&>();
+                const std::string &errMsg = errPair[0].get_ref<const std::string&>();
                 
                 nErr.errorList.push_back(std::make_pair(errMsg,errType));
                 nErr.errorString += "{" + errType + ":" + "'" +errMsg + "'} ";
@@ -176,80 +392,106 @@ namespace PrivateListener {
         
         //find the right callback to report this error on
         
-        //if operation is a connected session operation...
-        std::array<std::string,7> secureOp = {"random","symmetricKey","sign","totp","buzz","info"};
-        if (std::any_of(secureOp.begin(),secureOp.end(), [&](std::string op){return opVal.find(op) != std::string::npos; })) {
-            //we need an exchange to look up the callback
-            std::string exchange;
-            if (getExchange(jobj,exchange,false)){
-                auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-                if (exchangeCallback != NymiProvision::nymiProvisions.end()){
-                    
-                    //get pid
-                    std::string pid = "";
-                    getPid(jobj,pid);
-                    
-                    //report error on appropriate callback
-                    if (opVal == "random/run") { exchangeCallback->second(failure,pid,"",nErr); }
-                    else if (opVal == "symmetricKey/run") { exchangeCallback->second(failure,pid,nErr); }
-                    else if (opVal == "symmetricKey/get") { exchangeCallback->second(failure,pid,"",nErr); }
-                    else if (opVal == "totp/run") { exchangeCallback->second(failure,pid,nErr); }
-                    else if (opVal == "totp/get") { exchangeCallback->second(failure,pid,"",nErr); }
-                    else if (opVal == "sign/run") { exchangeCallback->second(failure,pid,"","",nErr); }
-                    else if (opVal == "notify/run") { exchangeCallback->second(failure,pid,HapticNotification::ERROR,nErr); }
-                    else if (opVal == "info") {
-                        //since there is an exchangeCallback, this was a request to NymiProvision::getDeviceInfo()
-                        
-                        //get pid from the exchange
-                        size_t pidstart = exchange.find("deviceinfo") + std::strlen("deviceinfo");
-                        pid = exchange.substr(pidstart);
-                        
-                        TransientNymiBandInfo blank;
-                        exchangeCallback->second(failure,pid,blank,nErr);
-                    }
-                    
-                    //remove <exchange,callback> entry
-                    NymiProvision::nymiProvisions.erase(exchange);
-                    return;
-                }
-            }
+        //if the error is for a request made on a NymiProvision, the exchange tells us which callback and which operation
+        std::string exchange;
+        NymiProvision::PendingExchange pending;
+        ExchangeOp op;
+        if (getExchange(jobj,exchange,false) && takePendingExchange(exchange,pending,op)){
+            
+            PrivateMetrics::recordError(op);
+            reportExchangeFailure(op,pending,nErr);
+            return;
         }
         //report on general error callback
         onError(nErr);
     }
+    
+    void reportExchangeFailure(ExchangeOp op, NymiProvision::PendingExchange &pending, const napiError &nErr) {
+        
+        const std::string &pid = *pending.pid;
+        auto &exchangeCallback = pending.callback;
+        KeyType keyType = KeyType::ERROR;
+        std::map<std::string,TransientNymiBandInfo> noInfo;
+        
+        //report error on appropriate callback
+        switch (op) {
+            case ExchangeOp::RANDOM:
+            case ExchangeOp::GET_SYMMETRIC_KEY:
+            case ExchangeOp::GET_TOTP: exchangeCallback(failure,pid,"",nErr); break;
+            case ExchangeOp::SIGN: exchangeCallback(failure,pid,"","",nErr); break;
+            case ExchangeOp::NOTIFY: exchangeCallback(failure,pid,HapticNotification::ERROR,nErr); break;
+            case ExchangeOp::DEVICE_INFO: exchangeCallback(failure,noInfo,nErr); break;
+            case ExchangeOp::CREATE_SYMMETRIC_KEY: keyType = KeyType::SYMMETRIC; exchangeCallback(failure,pid,keyType,nErr); break;
+            case ExchangeOp::CREATE_TOTP: keyType = KeyType::TOTP; exchangeCallback(failure,pid,keyType,nErr); break;
+            case ExchangeOp::REVOKE_KEY: exchangeCallback(failure,pid,keyType,nErr); break;
+            case ExchangeOp::REVOKE_PROVISION: exchangeCallback(failure,pid,nErr); break;
+            default: break;
+        }
+    }
+    
+    void expireRequests(std::vector<ExchangeId> &expired) {
+        
+        expired.clear();
+        NymiProvision::deadlines.advance(std::chrono::steady_clock::now(),expired);
+        
+        for (const ExchangeId &id : expired) {
+            
+            //the response may have been taken between the deadline passing and now
+            NymiProvision::PendingExchange pending;
+            if (!NymiProvision::nymiProvisions.take(id,pending)) continue;
+            
+            expiredCount.fetch_add(1, std::memory_order_relaxed);
+            PrivateMetrics::recordTimeout(id.op);
+            if (PrivateTrace::enabled()) PrivateTrace::end(id.seq,id.op,"timeout");
+            
+            napiError nErr { "ERROR. No response from napi before the request deadline.", { std::make_pair(std::string("request timed out"), std::string("timeout")) } };
+            ExchangeOp op = id.op;
+            
+            CallbackExecutor *executor = callbackExecutor.load();
+            if (executor == nullptr) {
+                reportExchangeFailure(op,pending,nErr);
+                continue;
+            }
+            
+            const std::string *pid = pending.pid;
+            auto shared = std::make_shared<NymiProvision::PendingExchange>(std::move(pending));
+            executor->post(*pid, [op, shared, nErr]{ reportExchangeFailure(op,*shared,nErr); });
+        }
+    }
 
     void handleOpProvision(nljson &jobj) {
         
-        nljson::iterator jit;
-        hasKey(jobj,{"operation"},jit);
-        if (jit.value()[1] == "report"){
+        nljson *jval;
+        hasKey(jobj,{"operation"},jval);
+        if ((*jval)[1] == "report"){
             
-            if (jit.value()[2] == "patterns"){
+            if ((*jval)[2] == "patterns"){
                 //handle receipt of provisioning pattern
-                if (hasKey(jobj,{"event","patterns"},jit)){
+                if (hasKey(jobj,{"event","patterns"},jval)){
 
-                    size_t num_patterns = jit.value().size();
+                    size_t num_patterns = jval->size();
                     std::vector<std::string> patterns;
+                    patterns.reserve(num_patterns);
                     
+                    //the json is not used after this, the patterns are moved out of it
                     for (unsigned int i = 0; i < num_patterns; ++i) {
-                        patterns.push_back(jit.value()[i]);
+                        patterns.push_back(std::move((*jval)[i].get_ref<std::string&>()));
                     }
                     onAgreement(patterns);
                 }
             }
-            else if (jit.value()[2] == "provisioned"){
+            else if ((*jval)[2] == "provisioned"){
                 //handle provisioned device
-                if (hasKey(jobj,{"event","kind"},jit) && jit.value() == "provisioned"){
-                    if (hasKey(jobj,{"event","info","pid"},jit)){
-                        std::string pid = jit.value();
-                        onProvision(NymiProvision(pid));
+                if (hasKey(jobj,{"event","kind"},jval) && *jval == "provisioned"){
+                    if (hasKey(jobj,{"event","info","pid"},jval)){
+                        onProvision(NymiProvision(jval->get_ref<const std::string&>()));
                     }
                 }
             }
         }
-        else if (jit.value()[1] == "run" && (jit.value()[2] == "start" || jit.value()[2] == "stop")){
+        else if ((*jval)[1] == "run" && ((*jval)[2] == "start" || (*jval)[2] == "stop")){
             
-            std::string provState = jit.value()[2];
+            const std::string &provState = (*jval)[2].get_ref<const std::string&>();
             if (onProvisionModeChange){ onProvisionModeChange(provState); }
         }
     }
@@ -260,49 +502,56 @@ namespace PrivateListener {
         std::string exchange;
         if (!getExchange(jobj,exchange,true)) return;
         
-        nljson::iterator jit;
+        nljson *jval;
         
         if (exchange == "provisions" || exchange == "provisionsPresent") {
 			std::vector<NymiProvision> provList;
-            if (hasKey(jobj, {"response",exchange}, jit)) {
-				auto napiProvList = jit.value();
-				for (auto p : napiProvList) {
-					std::string pid = p;
-					provList.push_back(NymiProvision(pid));
+            if (hasKey(jobj, {"response",exchange.c_str()}, jval)) {
+				auto &napiProvList = *jval;
+				provList.reserve(napiProvList.size());
+				for (auto &p : napiProvList) {
+					provList.push_back(bandHandle(p.get_ref<const std::string&>()));
 				}
 			}
             getProvisionList(provList);
         }
-        else if (exchange.find("deviceinfo") != std::string::npos){
-            
-            //get pid from the exchange
-            size_t pidstart = exchange.find("deviceinfo") + std::strlen("deviceinfo");
-            std::string pid = exchange.substr(pidstart);
-            if (hasKey(jobj,{"response","provisionMap"},jit)){
-                std::map<std::string,int> provisionMap = jit.value();
-                unsigned int idx = provisionMap[pid];
-                if (hasKey(jobj,{"response","nymiband"},jit)){
-                    auto nymiBands = jit.value();
-                    if (idx < nymiBands.size()){
-                        nljson deviceInfo = nymiBands[idx];
-                        TransientNymiBandInfo ndinfo(deviceInfo);
-                        
-                        //send value to the callback associated with the exchange
-                        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-                        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
-                            exchangeCallback->second(success,pid,ndinfo,noErr);
-                            NymiProvision::nymiProvisions.erase(exchangeCallback);
-                        }
-                        else {
-                            std::string errMsg = "ERROR. Received device info. No callback to NEA found. Json response follows:\n";
-                            errMsg += jobj.dump();
-                            napiError nErr = { errMsg, {} };
-                            onError(nErr);
-                            return;
-                        }
-                    }
-                }
+        else {
+            
+            //otherwise this is the response to the info request shared by NymiProvision::getDeviceInfo() and NymiApi::getAllDeviceInfo()
+            NymiProvision::PendingExchange pending;
+            ExchangeOp op;
+            if (!takePendingExchange(exchange,pending,op) || op != ExchangeOp::DEVICE_INFO){
+                std::string errMsg = "ERROR. Received device info. No callback to NEA found. Json response follows:\n";
+                errMsg += jobj.dump();
+                napiError nErr = { errMsg, {} };
+                onError(nErr);
+                return;
+            }
+            
+            auto &exchangeCallback = pending.callback;
+            std::map<std::string,TransientNymiBandInfo> infoByPid;
+            
+            if (!hasKey(jobj,{"response","provisionMap"},jval)){
+                exchangeCallback(failure,infoByPid,genMissingJsonKeyErr("response/provisionMap",jobj));
+                return;
+            }
+            auto &provisionMap = *jval;
+            if (!hasKey(jobj,{"response","nymiband"},jval) || !jval->is_array()){
+                exchangeCallback(failure,infoByPid,genMissingJsonKeyErr("response/nymiband",jobj));
+                return;
+            }
+            auto &nymiband = *jval;
+            
+            //decode every band once
+            for (auto pit = provisionMap.begin(); pit != provisionMap.end(); ++pit) {
+                if (!pit.value().is_number_unsigned() && !pit.value().is_number_integer()) continue;
+                std::size_t idx = pit.value();
+                if (idx >= nymiband.size()) continue;
+                infoByPid.emplace(pit.key(), TransientNymiBandInfo(nymiband[idx]));
             }
+            
+            //send the bands to the callback associated with the exchange
+            exchangeCallback(success,infoByPid,noErr);
         }
     }
 
@@ -313,30 +562,29 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
 
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
             
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+            auto &callbackFn = pending.callback;
             
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid,nErr)) {
-                callbackFn(failure,pid,"",nErr);   //pid is empty string
+                callbackFn(failure,*pid,"",nErr);   //pid is empty string
                 return;
             }
             
-            nljson::iterator jit;
+            nljson *jval;
             
             //get the value we want
-            if (!hasKey(jobj, {"response","pseudoRandomNumber"}, jit)) {
-                callbackFn(failure,pid,"",genMissingJsonKeyErr("pseudoRandomNumber",jobj));
+            if (!hasKey(jobj, {"response","pseudoRandomNumber"}, jval)) {
+                callbackFn(failure,*pid,"",genMissingJsonKeyErr("pseudoRandomNumber",jobj));
                 return;
             }
-            std::string rand = jit.value();
+            const std::string &rand = jval->get_ref<const std::string&>();
         
-            callbackFn(success,pid,rand,noErr);
+            callbackFn(success,*pid,rand,noErr);
             return;
         }
         else {
@@ -355,31 +603,30 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
         
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
             
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+            auto &callbackFn = pending.callback;
             
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid)) {
-                callbackFn(failure,pid,"",nErr);   //pid is empty string
+                callbackFn(failure,*pid,"",nErr);   //pid is empty string
                 return;
             }
         
-            nljson::iterator jit;
+            nljson *jval;
             
-            hasKey(jobj,{"operation"},jit);
-            if (jit.value()[1] == "run"){
+            hasKey(jobj,{"operation"},jval);
+            if ((*jval)[1] == "run"){
                 KeyType keyType = KeyType::SYMMETRIC;
-                callbackFn(isKeyValue(jobj, {"successful"}, jit, true),pid,keyType,noErr);
+                callbackFn(isKeyValue(jobj, {"successful"}, jval, true),*pid,keyType,noErr);
             }
-            else if (jit.value()[1] == "get"){
-                if (hasKey(jobj,{"response","key"},jit)){
-                    std::string key = jit.value();
-                    callbackFn(success,pid,key,noErr);
+            else if ((*jval)[1] == "get"){
+                if (hasKey(jobj,{"response","key"},jval)){
+                    const std::string &key = jval->get_ref<const std::string&>();
+                    callbackFn(success,*pid,key,noErr);
                 }
             }
             return;
@@ -400,39 +647,38 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
         
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
             
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+            auto &callbackFn = pending.callback;
             
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid,nErr)) {
-                callbackFn(failure,pid,"","",nErr);   //pid is empty string
+                callbackFn(failure,*pid,"","",nErr);   //pid is empty string
                 return;
             }
         
-            nljson::iterator jit;
+            nljson *jval;
             
             //get the value we want
-            if (!hasKey(jobj, {"response","signature"}, jit)) {
+            if (!hasKey(jobj, {"response","signature"}, jval)) {
 
-                callbackFn(failure,pid,"","",genMissingJsonKeyErr("signature",jobj));
+                callbackFn(failure,*pid,"","",genMissingJsonKeyErr("signature",jobj));
                 return;
             }
-            std::string sig = jit.value();
+            const std::string &sig = jval->get_ref<const std::string&>();
             
-            if (!hasKey(jobj, {"response","verificationKey"}, jit)) {
+            if (!hasKey(jobj, {"response","verificationKey"}, jval)) {
                 
-                callbackFn(failure,pid,"","",genMissingJsonKeyErr("verificationKey",jobj));
+                callbackFn(failure,*pid,"","",genMissingJsonKeyErr("verificationKey",jobj));
                 return;
             }
-            std::string vk = jit.value();
+            const std::string &vk = jval->get_ref<const std::string&>();
             
             //send value to the callback associated with the exchange
-            callbackFn(success,pid,sig,vk,noErr);
+            callbackFn(success,*pid,sig,vk,noErr);
             return;
         }
         else {
@@ -451,44 +697,43 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
         
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
-        
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
+            
+            auto &callbackFn = pending.callback;
             
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid)) {
-                callbackFn(failure,pid,nErr);   //pid is empty string
+                callbackFn(failure,*pid,nErr);   //pid is empty string
                 return;
             }
             
-            nljson::iterator jit;
+            nljson *jval;
             
             //get the value we want
-            if (!isKeyValue(jobj, {"successful"}, jit, true)) {
+            if (!isKeyValue(jobj, {"successful"}, jval, true)) {
                 std::string errMsg = "Could not complete CreateTOTP request. JSON response follows:\n";
                 errMsg += jobj.dump();
                 napiError nErr { errMsg, {} };
-                callbackFn(failure,pid,nErr);
+                callbackFn(failure,*pid,nErr);
                 return;
             }
             
-            hasKey(jobj,{"operation"},jit);
-            if (jit.value()[1] == "run"){
+            hasKey(jobj,{"operation"},jval);
+            if ((*jval)[1] == "run"){
                 KeyType keyType = KeyType::TOTP;
-                callbackFn(isKeyValue(jobj, {"successful"}, jit, true),pid,keyType,noErr);
+                callbackFn(isKeyValue(jobj, {"successful"}, jval, true),*pid,keyType,noErr);
             }
-            else if (jit.value()[1] == "get"){
-                if (!hasKey(jobj, {"response","totp"}, jit)) {
+            else if ((*jval)[1] == "get"){
+                if (!hasKey(jobj, {"response","totp"}, jval)) {
 
-                    callbackFn(failure,pid,"",genMissingJsonKeyErr("response/totp",jobj));
+                    callbackFn(failure,*pid,"",genMissingJsonKeyErr("response/totp",jobj));
                     return;
                 }
-                std::string totpid = jit.value();
-                callbackFn(success,pid,totpid,noErr);
+                const std::string &totpid = jval->get_ref<const std::string&>();
+                callbackFn(success,*pid,totpid,noErr);
             }
             
             return;
@@ -509,33 +754,32 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
         
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
             
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+            auto &callbackFn = pending.callback;
             
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid,nErr)) {
-                callbackFn(failure,pid,"",nErr);   //pid is empty string
+                callbackFn(failure,*pid,"",nErr);   //pid is empty string
                 return;
             }
         
-            nljson::iterator jit;
+            nljson *jval;
 
-            if (!hasKey(jobj, {"request","buzz"}, jit)) {
+            if (!hasKey(jobj, {"request","buzz"}, jval)) {
 
-                callbackFn(failure,pid,HapticNotification::ERROR,genMissingJsonKeyErr("request/buzz",jobj));
+                callbackFn(failure,*pid,HapticNotification::ERROR,genMissingJsonKeyErr("request/buzz",jobj));
                 return;
             }
             
-            bool notifyVal= jit.value();
+            bool notifyVal= *jval;
             HapticNotification notifyType = (notifyVal) ? HapticNotification::NOTIFY_POSITIVE : HapticNotification::NOTIFY_NEGATIVE;
             
             //send value to the callback associated with the exchange
-            callbackFn(success,pid,notifyType,noErr);
+            callbackFn(success,*pid,notifyType,noErr);
             return;
         }
         else {
@@ -549,39 +793,56 @@ namespace PrivateListener {
 
     void handleOpApiNotifications(nljson &jobj) {
         
-        nljson::iterator jit;
-        hasKey(jobj, {"operation"},jit);
+        nljson *jval;
+        hasKey(jobj, {"operation"},jval);
         
-        if (jit.value()[1] == "set"){/*response of set is received here, not handling it for now*/}
-        else if (jit.value()[1] == "report") {
+        if ((*jval)[1] == "set"){/*response of set is received here, not handling it for now*/}
+        else if ((*jval)[1] == "report") {
             
-            if (hasKey(jobj, {"event","kind"},jit)){
+            if (hasKey(jobj, {"event","kind"},jval)){
                 
-                std::string eventType = jit.value();
+                const std::string &eventType = jval->get_ref<const std::string&>();
 
                 if (eventType == "found-change" || eventType == "presence-change"){
                     
-                    std::string before, after, pid;
+                    const std::string *before = &noString, *after = &noString, *pid = &noString;
                     
-                    if(hasKey(jobj, {"event","before"},jit)) { before = jit.value(); }
-                    if(hasKey(jobj, {"event","after"},jit)) { after = jit.value(); }
-                    if (hasKey(jobj, {"event","pid"}, jit)) { pid = jit.value(); }
+                    if(hasKey(jobj, {"event","before"},jval)) { before = &jval->get_ref<const std::string&>(); }
+                    if(hasKey(jobj, {"event","after"},jval)) { after = &jval->get_ref<const std::string&>(); }
+                    if (hasKey(jobj, {"event","pid"}, jval)) { pid = &jval->get_ref<const std::string&>(); }
+                    
+                    //the state table is updated first, so callbacks reading it see the change they are told about
+                    auto now = std::chrono::steady_clock::now();
+                    BandNotification notification;
+                    notification.band = bandHandle(*pid);
+                    std::uint32_t pidIndex = NymiProvision::bandIndex(notification.band);
                     
                     if (eventType == "found-change"){
-                        onFoundChange(pid,stringToFoundStatus(before),stringToFoundStatus(after));
+                        notification.kind = BandNotificationKind::FOUND_CHANGE;
+                        notification.foundBefore = stringToFoundStatus(*before);
+                        notification.foundAfter = stringToFoundStatus(*after);
+                        NymiProvision::bandStates.setFound(pidIndex,notification.foundAfter,now);
+                        if (onFoundChange) onFoundChange(*pid,notification.foundBefore,notification.foundAfter);
                     }
                     else if (eventType == "presence-change"){
                         
                         bool authenticated = false;
-                        if (hasKey(jobj, {"event","authenticated"},jit)){ authenticated = jit.value(); }
-                        onPresenceChange(pid,stringToPresenceStatus(before),stringToPresenceStatus(after),authenticated);
+                        if (hasKey(jobj, {"event","authenticated"},jval)){ authenticated = *jval; }
+                        notification.kind = BandNotificationKind::PRESENCE_CHANGE;
+                        notification.presenceBefore = stringToPresenceStatus(*before);
+                        notification.presenceAfter = stringToPresenceStatus(*after);
+                        notification.authenticated = authenticated;
+                        NymiProvision::bandStates.setPresence(pidIndex,notification.presenceAfter,authenticated,now);
+                        if (onPresenceChange) onPresenceChange(*pid,notification.presenceBefore,notification.presenceAfter,authenticated);
                     }
+                    
+                    bandNotifications.publish(notification);
                 }
             }
         }
-        else if (jit.value()[1] == "get" && hasKey(jobj,{"response"},jit)) {
+        else if ((*jval)[1] == "get" && hasKey(jobj,{"response"},jval)) {
             
-            std::map<std::string,bool> notificationsState = jit.value();
+            std::map<std::string,bool> notificationsState = *jval;
             onNotificationsGet(notificationsState);
         }
     }
@@ -593,22 +854,21 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
 
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
-
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
+            
+            auto &callbackFn = pending.callback;
 
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid,nErr)) {
-                callbackFn(failure,pid,nErr);   //pid is empty string
+                callbackFn(failure,*pid,nErr);   //pid is empty string
                 return;
             }
 
             //send value to the callback associated with the exchange
-            callbackFn(success,pid,noErr);
+            callbackFn(success,*pid,noErr);
             return;
         }
         else {
@@ -627,31 +887,30 @@ namespace PrivateListener {
         if (!getExchange(jobj,exchange,true)) return;
 
         //send value to the callback associated with the exchange
-        auto exchangeCallback = NymiProvision::nymiProvisions.find(exchange);
-        if (exchangeCallback != NymiProvision::nymiProvisions.end()){
-
-            auto callbackFn = exchangeCallback->second;
-            NymiProvision::nymiProvisions.erase(exchangeCallback);
+        NymiProvision::PendingExchange pending;
+        if (takePendingExchange(exchange,pending)){
+            
+            auto &callbackFn = pending.callback;
 
             //get pid
-            std::string pid;
+            const std::string *pid;
             napiError nErr;
             if (!getPid(jobj,pid,nErr)) {
                 KeyType keyType = KeyType::ERROR;
-                callbackFn(failure,pid,keyType,nErr);   //pid is empty string
+                callbackFn(failure,*pid,keyType,nErr);   //pid is empty string
                 return;
             }
 
             //send value to the callback associated with the exchange
             KeyType keyType = KeyType::ERROR;
-            nljson::iterator jit;
-            if (isKeyValue(jobj, {"request","symmetric"},jit,true) && isKeyValue(jobj, {"response","symmetric"},jit,false)){
+            nljson *jval;
+            if (isKeyValue(jobj, {"request","symmetric"},jval,true) && isKeyValue(jobj, {"response","symmetric"},jval,false)){
                 keyType = KeyType::SYMMETRIC;
             }
-            else if (isKeyValue(jobj, {"request","totp"},jit,true) && isKeyValue(jobj, {"response","totp"},jit,false)){
+            else if (isKeyValue(jobj, {"request","totp"},jval,true) && isKeyValue(jobj, {"response","totp"},jval,false)){
                 keyType = KeyType::TOTP;
             }
-            callbackFn(success,pid,keyType,noErr);
+            callbackFn(success,*pid,keyType,noErr);
             return;
         }
         else {
@@ -9,9 +9,15 @@
 #ifndef Listener_hpp
 #define Listener_hpp
 
+#include <chrono>
 #include <functional>
 #include "NeaCallbackTypes.h"
 #include "JsonUtilityFunctions.h"
+#include "NymiProvision.h"
+#include "LatencyHistogram.h"
+#include "CallbackExecutor.h"
+#include "NotificationBus.h"
+#include "WrapperLog.h"
 
 namespace PrivateListener {
     
@@ -21,11 +27,28 @@ namespace PrivateListener {
     //loop variable in waitForMessage
     void setQuit(bool _quit);
     
+    //bounds of the jsonNapiGet timeout in waitForMessage. the timeout drops to the minimum when a message
+    //arrives and doubles, up to the maximum, each time napi has nothing to report.
+    void setPollInterval(int _minPollMs, int _maxPollMs);
+    
+    //time from receiving a message from napi to returning from its handler, including the NEA callback.
+    //with a callback executor, to posting the message to the executor
+    LatencyHistogram::Snapshot getDispatchLatency();
+    
+    //number of requests failed because napi did not answer before their deadline
+    std::uint64_t getExpiredCount();
+    
+    //subscribers to found-change and presence-change, in addition to the single onFoundChange and onPresenceChange
+    NotificationBus &getNotificationBus();
+    
+    //if set, messages are handled, and NEA callbacks called, on the executor's threads instead of NymiApi::listener
+    void setCallbackExecutor(CallbackExecutor *_callbackExecutor);
+    
     //some utility functions
-    inline bool printResultIfFalse(std::function<bool(std::vector<std::string>)> call,std::vector<std::string> field, bool print = true){
+    inline bool printResultIfFalse(bool found, const char *field, bool print = true){
     
-        if (!call(field)){
-            if (print) { std::cerr<<"INFO: Json from Napi is missing field "<<field[0]<<std::endl; }
+        if (!found){
+            if (print) { NAPICPP_LOG(WrapperLogLevel::info, "Json from Napi is missing field " << field); }
             return false;
         }
         return true;
@@ -40,23 +63,48 @@ namespace PrivateListener {
      */
     inline bool wellConstructedJson(nljson &jobj){
         
-        nljson::iterator jit;
-        auto callHasKey = std::bind(hasKey,std::ref(jobj),std::placeholders::_1,std::ref(jit));
+        nljson *jval;
         bool print = false;
         
-        return (printResultIfFalse(callHasKey,{"operation"},print) &&
-                (printResultIfFalse(callHasKey,{"response"},print) || printResultIfFalse(callHasKey,{"errors"},print) || printResultIfFalse(callHasKey,{"event"},print)) &&
-                printResultIfFalse(callHasKey,{"successful"},print)  &&
-                printResultIfFalse(callHasKey,{"exchange"},print)
+        return (printResultIfFalse(hasKey(jobj,{"operation"},jval),"operation",print) &&
+                (printResultIfFalse(hasKey(jobj,{"response"},jval),"response",print) || printResultIfFalse(hasKey(jobj,{"errors"},jval),"errors",print) || printResultIfFalse(hasKey(jobj,{"event"},jval),"event",print)) &&
+                printResultIfFalse(hasKey(jobj,{"successful"},jval),"successful",print)  &&
+                printResultIfFalse(hasKey(jobj,{"exchange"},jval),"exchange",print)
                 );
     }
     
     bool getExchange(nljson &jobj, std::string &exchange, bool errorIfNoExchange);
     bool getPid(nljson &jobj, std::string &pid, napiError &nErr);
     bool getPid(nljson &jobj, std::string &pid);
+    
+    //as above, without copying: pid points into jobj, or at an empty string if there is no pid
+    bool getPid(nljson &jobj, const std::string *&pid, napiError &nErr);
+    bool getPid(nljson &jobj, const std::string *&pid);
+    
+    //decodes the exchange of a response to a NymiProvision request, and removes the pending request from NymiProvision::nymiProvisions
+    bool takePendingExchange(const std::string &exchange, NymiProvision::PendingExchange &pending, ExchangeOp &op);
+    bool takePendingExchange(const std::string &exchange, NymiProvision::PendingExchange &pending);
+
+    //handle of the band with pid, from a table kept by the message handlers. called on the listener thread or,
+    //with a callback executor, on its workers
+    NymiProvision bandHandle(const std::string &pid);
+
+    //runs task on the listener thread, after the message being handled, or within pollTimeout if it is waiting for one.
+    //false, and task is not run, if the listener is not running
+    bool runOnListener(std::function<void()> task);
+    void runTasks();
 
     //running on the thread NymiApi::listener
     void waitForMessage();
+    int pollTimeout(int timeoutMs);
+    void dispatchMessage(const std::string &message, std::chrono::steady_clock::time_point received);
+    void handleMessage(nljson &jobj);
+    
+    //fails the requests whose deadline has passed, see NymiProvision::deadlines. expired is scratch space
+    void expireRequests(std::vector<ExchangeId> &expired);
+    
+    //calls the callback of a request made on a NymiProvision with opResult false
+    void reportExchangeFailure(ExchangeOp op, NymiProvision::PendingExchange &pending, const napiError &nErr);
 
     //handle operations from napi
     void handleNapiError(nljson &jobj);
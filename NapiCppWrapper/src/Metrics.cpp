@@ -0,0 +1,147 @@
+//
+//  Metrics.cpp
+//  NapiCpp
+//
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "Metrics.h"
+
+namespace PrivateMetrics {
+
+    enum OpKind { RANDOM, SIGN, SYMMETRIC_KEY, TOTP, BUZZ, INFO, REVOKE, KEY, NUM_OP_KINDS };
+
+    const char *opKindNames[NUM_OP_KINDS] = { "random", "sign", "symmetricKey", "totp", "buzz", "info", "revoke", "key" };
+
+    //named after the napi operation the request is sent as
+    int opKind(ExchangeOp op) {
+
+        switch (op) {
+            case ExchangeOp::RANDOM: return RANDOM;
+            case ExchangeOp::SIGN: return SIGN;
+            case ExchangeOp::CREATE_SYMMETRIC_KEY:
+            case ExchangeOp::GET_SYMMETRIC_KEY: return SYMMETRIC_KEY;
+            case ExchangeOp::CREATE_TOTP:
+            case ExchangeOp::GET_TOTP: return TOTP;
+            case ExchangeOp::NOTIFY: return BUZZ;
+            case ExchangeOp::DEVICE_INFO: return INFO;
+            case ExchangeOp::REVOKE_PROVISION: return REVOKE;
+            case ExchangeOp::REVOKE_KEY: return KEY;
+            default: return -1;
+        }
+    }
+
+    struct Counters {
+        std::atomic<std::uint64_t> requests{ 0 };
+        std::atomic<std::uint64_t> errors{ 0 };
+        std::atomic<std::uint64_t> timeouts{ 0 };
+        LatencyHistogram latency;
+    };
+
+    Counters counters[NUM_OP_KINDS];
+
+    void recordRequest(ExchangeOp op) {
+        int kind = opKind(op);
+        if (kind >= 0) counters[kind].requests.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordError(ExchangeOp op) {
+        int kind = opKind(op);
+        if (kind >= 0) counters[kind].errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordTimeout(ExchangeOp op) {
+        int kind = opKind(op);
+        if (kind >= 0) counters[kind].timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void recordLatency(ExchangeOp op, std::uint64_t us) {
+        int kind = opKind(op);
+        if (kind >= 0) counters[kind].latency.record(us);
+    }
+
+    void snapshotOps(MetricsSnapshot &snapshot) {
+
+        snapshot.ops.clear();
+        snapshot.ops.resize(NUM_OP_KINDS);
+        for (int kind = 0; kind < NUM_OP_KINDS; ++kind) {
+            OpMetrics &m = snapshot.ops[kind];
+            m.op = opKindNames[kind];
+            m.requests = counters[kind].requests.load(std::memory_order_relaxed);
+            m.errors = counters[kind].errors.load(std::memory_order_relaxed);
+            m.timeouts = counters[kind].timeouts.load(std::memory_order_relaxed);
+            m.latency = counters[kind].latency.snapshot();
+        }
+    }
+
+    std::string toPrometheus(const MetricsSnapshot &snapshot) {
+
+        //le boundaries of the exported histogram, in us. a histogram bucket straddling a boundary is counted above it
+        static const std::uint64_t boundariesUs[] = { 1000, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 30000000, 60000000 };
+
+        std::ostringstream out;
+
+        out << "# HELP napicpp_requests_total Requests made on a NymiProvision.\n";
+        out << "# TYPE napicpp_requests_total counter\n";
+        for (auto &m : snapshot.ops) out << "napicpp_requests_total{op=\"" << m.op << "\"} " << m.requests << "\n";
+
+        out << "# HELP napicpp_request_errors_total Requests answered by napi with an error.\n";
+        out << "# TYPE napicpp_request_errors_total counter\n";
+        for (auto &m : snapshot.ops) out << "napicpp_request_errors_total{op=\"" << m.op << "\"} " << m.errors << "\n";
+
+        out << "# HELP napicpp_request_timeouts_total Requests not answered before their deadline.\n";
+        out << "# TYPE napicpp_request_timeouts_total counter\n";
+        for (auto &m : snapshot.ops) out << "napicpp_request_timeouts_total{op=\"" << m.op << "\"} " << m.timeouts << "\n";
+
+        out << "# HELP napicpp_request_duration_seconds Time from a request being queued to its callback returning.\n";
+        out << "# TYPE napicpp_request_duration_seconds histogram\n";
+        for (auto &m : snapshot.ops) {
+
+            std::size_t bucket = 0;
+            std::uint64_t cumulative = 0;
+            for (std::uint64_t le : boundariesUs) {
+                while (bucket < m.latency.buckets.size() && bucket + 1 < (std::size_t)LatencyHistogram::numBuckets &&
+                       LatencyHistogram::bucketLowerBound((int)bucket + 1) <= le) {
+                    cumulative += m.latency.buckets[bucket++];
+                }
+                out << "napicpp_request_duration_seconds_bucket{op=\"" << m.op << "\",le=\"" << le / 1e6 << "\"} " << cumulative << "\n";
+            }
+            out << "napicpp_request_duration_seconds_bucket{op=\"" << m.op << "\",le=\"+Inf\"} " << m.latency.count << "\n";
+            out << "napicpp_request_duration_seconds_sum{op=\"" << m.op << "\"} " << m.latency.sumUs / 1e6 << "\n";
+            out << "napicpp_request_duration_seconds_count{op=\"" << m.op << "\"} " << m.latency.count << "\n";
+        }
+
+        out << "# HELP napicpp_pending_exchanges Requests waiting for an answer from napi.\n";
+        out << "# TYPE napicpp_pending_exchanges gauge\n";
+        out << "napicpp_pending_exchanges " << snapshot.pendingExchanges << "\n";
+
+        out << "# HELP napicpp_outbound_queue_depth Requests not yet handed to napi.\n";
+        out << "# TYPE napicpp_outbound_queue_depth gauge\n";
+        out << "napicpp_outbound_queue_depth " << snapshot.outboundQueueDepth << "\n";
+
+        out << "# HELP napicpp_callback_queue_depth Messages waiting for the callback executor.\n";
+        out << "# TYPE napicpp_callback_queue_depth gauge\n";
+        out << "napicpp_callback_queue_depth " << snapshot.callbackQueueDepth << "\n";
+
+        return out.str();
+    }
+
+    bool writePrometheus(const MetricsSnapshot &snapshot, const std::string &path) {
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::out | std::ios::trunc);
+            if (!file) return false;
+            file << toPrometheus(snapshot);
+            if (!file) return false;
+        }
+
+#ifdef _WIN32
+        std::remove(path.c_str());     //rename does not replace an existing file on Windows
+#endif
+        return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+    }
+
+} //end namespace PrivateMetrics
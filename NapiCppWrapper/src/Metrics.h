@@ -0,0 +1,54 @@
+//
+//  Metrics.h
+//  NapiCpp
+//
+//  Per operation counters and latency of the requests made on NymiProvision,
+//  and a Prometheus text exporter for them. See NymiApi::getMetrics.
+//
+
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ExchangeId.h"
+#include "LatencyHistogram.h"
+
+struct OpMetrics {
+
+    std::string op;             //random, sign, symmetricKey, totp, buzz, info, revoke, key
+    std::uint64_t requests = 0;
+    std::uint64_t errors = 0;   //answered by napi with an error
+    std::uint64_t timeouts = 0; //not answered before the deadline
+    LatencyHistogram::Snapshot latency;     //from the request being queued to its callback returning
+};
+
+struct MetricsSnapshot {
+
+    std::vector<OpMetrics> ops;
+    std::size_t pendingExchanges = 0;
+    std::size_t outboundQueueDepth = 0;     //requests not yet handed to napi
+    std::size_t callbackQueueDepth = 0;     //messages waiting for the callback executor, 0 without one
+};
+
+namespace PrivateMetrics {
+
+    //lock-free, called from the threads making requests and handling responses
+    void recordRequest(ExchangeOp op);
+    void recordError(ExchangeOp op);
+    void recordTimeout(ExchangeOp op);
+    void recordLatency(ExchangeOp op, std::uint64_t us);
+
+    //fills in ops, the gauges are left to the caller
+    void snapshotOps(MetricsSnapshot &snapshot);
+
+    //Prometheus text exposition format. latency buckets are folded into fixed boundaries from 1ms to 60s
+    std::string toPrometheus(const MetricsSnapshot &snapshot);
+
+    //writes to a temporary file next to path and renames it over path, so a scraper never reads half a file
+    bool writePrometheus(const MetricsSnapshot &snapshot, const std::string &path);
+
+} //end namespace PrivateMetrics
+
+#endif /* Metrics_h */
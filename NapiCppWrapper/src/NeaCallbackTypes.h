@@ -14,6 +14,7 @@
 #include <map>
 #include <utility>
 #include <functional>
+#include <future>
 #include "NymiApiEnums.h"
 
 class NymiProvision;
@@ -25,32 +26,68 @@ struct napiError {
     std::vector<std::pair<std::string,std::string> > errorList;
 };
 
+//result of an operation on a provisioned Nymi Band, delivered through the std::future overloads of NymiProvision
+template <typename T>
+struct NapiResult {
+    
+    bool opResult;
+    std::string pid;
+    T value;
+    napiError error;
+};
+
+struct EcdsaSignature {
+    
+    std::string signature;
+    std::string verificationKey;
+};
+
+//waits for every future, in order, and returns their results.
+//do not call from a NEA callback: the results are delivered on the thread that runs the callbacks.
+template <typename T>
+std::vector<T> getAll(std::vector<std::future<T> > &futures) {
+    
+    std::vector<T> results;
+    results.reserve(futures.size());
+    for (auto &f : futures) {
+        results.push_back(f.get());
+    }
+    return results;
+}
+
+/*
+    Callbacks receive their strings, lists and errors by const reference, into the parsed napi message
+    or the wrapper's own state, and valid only for the duration of the call. Callables taking the same
+    arguments by value, as these types did before, still convert to them and receive copies.
+ */
+
 //init and error
-using errorCallback = std::function<void(napiError nErr)>;
+using errorCallback = std::function<void(const napiError &nErr)>;
 
 //callbacks for provisioning a new band
-using agreementCallback = std::function<void(std::vector<std::string> patterns)>;
+using agreementCallback = std::function<void(const std::vector<std::string> &patterns)>;
 using newProvisionCallback = std::function<void(NymiProvision newprov)>;
 
 //callbacks for getting api state
-using getProvisionsCallback = std::function<void(std::vector<NymiProvision> provisions)>;
-using onNotificationsGetState = std::function<void(std::map<std::string,bool> notificationsState)>;
-using onStartStopProvisioning = std::function<void(std::string newState)>;
+using getProvisionsCallback = std::function<void(const std::vector<NymiProvision> &provisions)>;
+using onNotificationsGetState = std::function<void(const std::map<std::string,bool> &notificationsState)>;
+using onStartStopProvisioning = std::function<void(const std::string &newState)>;
+using allDeviceInfoCallback = std::function<void(bool opResult, std::map<std::string,TransientNymiBandInfo> &infoByPid, const napiError &)>;
 
 //callbacks for user-initiated operations on a provisioned Nymi Band
-using randomCallback =              std::function<void(bool opResult, std::string pid, std::string rand,                napiError)>;
-using symmetricKeyCallback =        std::function<void(bool opResult, std::string pid, std::string sk,                  napiError)>;
-using ecdsaSignCallback =           std::function<void(bool opResult, std::string pid, std::string sig, std::string vk, napiError)>;
-using totpGetCallback =             std::function<void(bool opResult, std::string pid, std::string totp,                napiError)>;
-using onNotificationCallback =      std::function<void(bool opResult, std::string pid, HapticNotification,              napiError)>;
-using deviceInfoCallback =          std::function<void(bool opResult, std::string pid, TransientNymiBandInfo&,          napiError)>;
-using createdKeyCallback =          std::function<void(bool opResult, std::string pid, KeyType,                         napiError)>;
-using revokedKeyCallback =          std::function<void(bool opResult, std::string pid, KeyType,                         napiError)>;
-using onProvisionRevokedCallback =  std::function<void(bool opResult, std::string pid,                                  napiError)>;
+using randomCallback =              std::function<void(bool opResult, const std::string &pid, const std::string &rand,                       const napiError &)>;
+using symmetricKeyCallback =        std::function<void(bool opResult, const std::string &pid, const std::string &sk,                         const napiError &)>;
+using ecdsaSignCallback =           std::function<void(bool opResult, const std::string &pid, const std::string &sig, const std::string &vk, const napiError &)>;
+using totpGetCallback =             std::function<void(bool opResult, const std::string &pid, const std::string &totp,                       const napiError &)>;
+using onNotificationCallback =      std::function<void(bool opResult, const std::string &pid, HapticNotification,                            const napiError &)>;
+using deviceInfoCallback =          std::function<void(bool opResult, const std::string &pid, TransientNymiBandInfo&,                        const napiError &)>;
+using createdKeyCallback =          std::function<void(bool opResult, const std::string &pid, KeyType,                                       const napiError &)>;
+using revokedKeyCallback =          std::function<void(bool opResult, const std::string &pid, KeyType,                                       const napiError &)>;
+using onProvisionRevokedCallback =  std::function<void(bool opResult, const std::string &pid,                                                const napiError &)>;
 
 //api notification - one way flow of information from api to nea.
 //notifications reported through these callbacks are not initiated by a specific user action or request, other than enabling the notification itself.
-using onNymiBandFoundStatusChange = std::function<void(std::string pid, FoundStatus before, FoundStatus after)>;
-using onNymiBandPresenceChange = std::function<void(std::string pid, PresenceStatus before, PresenceStatus after, bool authenticated)>;
+using onNymiBandFoundStatusChange = std::function<void(const std::string &pid, FoundStatus before, FoundStatus after)>;
+using onNymiBandPresenceChange = std::function<void(const std::string &pid, PresenceStatus before, PresenceStatus after, bool authenticated)>;
 
 #endif /* NeaCallbacks_h */
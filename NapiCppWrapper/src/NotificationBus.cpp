@@ -0,0 +1,134 @@
+//
+//  NotificationBus.cpp
+//  NapiCpp
+//
+
+#include "NotificationBus.h"
+#include <algorithm>
+#include <thread>
+
+NotificationBus::NotificationBus() :routes(new Routes()) {
+
+    for (auto &hazard : hazards) hazard.store(nullptr);
+}
+
+NotificationBus::~NotificationBus() {
+
+    delete routes.load();
+    for (const Routes *old : retired) delete old;
+}
+
+std::uint64_t NotificationBus::subscribe(bandNotificationCallback callback, unsigned kinds, const std::string &pid) {
+
+    if (!callback || (kinds & notifyAll) == 0) return 0;
+
+    std::shared_ptr<Subscriber> sub = std::make_shared<Subscriber>();
+    sub->kinds = kinds & notifyAll;
+    sub->pid = pid;
+    sub->callback = std::move(callback);
+
+    std::lock_guard<std::mutex> lock(mtx);
+    sub->token = nextToken++;
+    subscribers.push_back(sub);
+    rebuild();
+    return sub->token;
+}
+
+bool NotificationBus::unsubscribe(std::uint64_t token) {
+
+    std::lock_guard<std::mutex> lock(mtx);
+
+    for (auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+        if ((*it)->token == token) {
+            subscribers.erase(it);
+            rebuild();
+            return true;
+        }
+    }
+    return false;
+}
+
+void NotificationBus::rebuild() {
+
+    Routes *next = new Routes();
+    next->owned = subscribers;
+
+    for (auto &sub : subscribers) {
+
+        std::uint32_t pidIndex = 0;
+        bool seen = !sub->pid.empty() && NymiProvision::findPid(sub->pid, pidIndex) != nullptr;
+
+        for (int kind = 0; kind < numKinds; ++kind) {
+
+            if ((sub->kinds & (1u << kind)) == 0) continue;
+            if (sub->pid.empty()) next->anyBand[kind].push_back(sub.get());
+            else if (seen) next->byBand[kind][pidIndex].push_back(sub.get());
+            else next->byUnseenPid[kind][sub->pid].push_back(sub.get());
+        }
+    }
+
+    retired.push_back(routes.exchange(next));
+
+    //each publish call reads one table, the one its hazard slot points at
+    const Routes *inUse[hazardSlots];
+    for (int i = 0; i < hazardSlots; ++i) inUse[i] = hazards[i].load();
+    auto reclaim = [&inUse](const Routes *old){
+        if (std::find(inUse, inUse + hazardSlots, old) != inUse + hazardSlots) return false;
+        delete old;
+        return true;
+    };
+    retired.erase(std::remove_if(retired.begin(), retired.end(), reclaim), retired.end());
+}
+
+void NotificationBus::publish(const BandNotification &notification) {
+
+    int kind = static_cast<int>(notification.kind);
+    if (kind < 0 || kind >= numKinds) return;
+
+    //claim a free slot. its value only protects the table once it is confirmed to still be current
+    const Routes *current = routes.load();
+    std::atomic<const Routes*> *hazard = nullptr;
+    while (hazard == nullptr) {
+        for (auto &slot : hazards) {
+            const Routes *expected = nullptr;
+            if (slot.compare_exchange_strong(expected, current)) { hazard = &slot; break; }
+        }
+        if (hazard == nullptr) std::this_thread::yield();
+    }
+
+    //once the slot is set to the table that is still current, rebuild will not delete it
+    while (true) {
+        const Routes *again = routes.load();
+        if (again == current) break;
+        current = again;
+        hazard->store(current);
+    }
+
+    for (const Subscriber *sub : current->anyBand[kind]) {
+        sub->callback(notification);
+    }
+
+    auto it = current->byBand[kind].find(notification.band.m_index);
+    if (it != current->byBand[kind].end()) {
+        for (const Subscriber *sub : it->second) {
+            sub->callback(notification);
+        }
+    }
+
+    if (!current->byUnseenPid[kind].empty()) {
+        auto unseen = current->byUnseenPid[kind].find(notification.band.getPid());
+        if (unseen != current->byUnseenPid[kind].end()) {
+            for (const Subscriber *sub : unseen->second) {
+                sub->callback(notification);
+            }
+        }
+    }
+
+    hazard->store(nullptr);
+}
+
+std::size_t NotificationBus::subscriberCount() {
+
+    std::lock_guard<std::mutex> lock(mtx);
+    return subscribers.size();
+}
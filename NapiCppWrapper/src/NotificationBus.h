@@ -0,0 +1,108 @@
+//
+//  NotificationBus.h
+//  NapiCpp
+//
+//  Fan-out of the found-change and presence-change notifications to any number of subscribers,
+//  each optionally filtered by pid and by kind of notification.
+//
+
+#ifndef NotificationBus_h
+#define NotificationBus_h
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "NymiProvision.h"
+
+enum class BandNotificationKind { FOUND_CHANGE = 0, PRESENCE_CHANGE = 1 };
+
+//bit masks of BandNotificationKind, for NotificationBus::subscribe
+const unsigned notifyFoundChange = 1u << static_cast<unsigned>(BandNotificationKind::FOUND_CHANGE);
+const unsigned notifyPresenceChange = 1u << static_cast<unsigned>(BandNotificationKind::PRESENCE_CHANGE);
+const unsigned notifyAll = notifyFoundChange | notifyPresenceChange;
+
+//found fields are set for FOUND_CHANGE, presence fields and authenticated for PRESENCE_CHANGE
+struct BandNotification {
+
+    BandNotificationKind kind;
+    NymiProvision band;
+    FoundStatus foundBefore = FoundStatus::ERROR;
+    FoundStatus foundAfter = FoundStatus::ERROR;
+    PresenceStatus presenceBefore = PresenceStatus::ERROR;
+    PresenceStatus presenceAfter = PresenceStatus::ERROR;
+    bool authenticated = false;
+};
+
+using bandNotificationCallback = std::function<void(const BandNotification &notification)>;
+
+/*
+    Subscriptions are kept in an immutable routing table, indexed by kind and then by pid index.
+    subscribe and unsubscribe build a new table and swap it in; publish reads the current one and
+    only calls the subscribers registered for that kind and pid, or for any pid.
+    Publishing allocates nothing and takes no lock: the event is passed by reference and carries an
+    interned pid, and the table is published through an atomic pointer. Each publish claims one of
+    hazardSlots hazard pointers and sets it to the table it reads; a replaced table is deleted by a
+    later swap once no slot points at it.
+
+    With a callback executor, notifications are handled on its workers, so several publish calls can
+    run at once. If every slot is taken, publish yields until one is free.
+
+    Subscribing to a pid does not intern it. A pid with no NymiProvision handle yet is routed by its
+    string, until a later subscribe or unsubscribe rebuilds the table after the band has been seen.
+
+    A subscriber can still be called once after unsubscribe returns, by a publish that took the
+    routing table before the swap.
+ */
+class NotificationBus {
+
+public:
+
+    NotificationBus();
+    ~NotificationBus();
+
+    //returns the token to unsubscribe with, 0 if the arguments are invalid.
+    //pid empty subscribes to every band
+    std::uint64_t subscribe(bandNotificationCallback callback, unsigned kinds = notifyAll, const std::string &pid = "");
+    bool unsubscribe(std::uint64_t token);
+
+    //called from any thread. subscribers may subscribe and unsubscribe from the callback
+    void publish(const BandNotification &notification);
+
+    std::size_t subscriberCount();
+
+private:
+
+    static const int numKinds = 2;
+    static const int hazardSlots = 32;
+
+    struct Subscriber {
+        std::uint64_t token;
+        unsigned kinds;
+        std::string pid;            //empty for every band
+        bandNotificationCallback callback;
+    };
+
+    struct Routes {
+        std::vector<const Subscriber*> anyBand[numKinds];
+        std::unordered_map<std::uint32_t, std::vector<const Subscriber*> > byBand[numKinds];
+        std::unordered_map<std::string, std::vector<const Subscriber*> > byUnseenPid[numKinds];
+        std::vector<std::shared_ptr<const Subscriber> > owned;
+    };
+
+    //rebuilds the routing table from subscribers and swaps it in, called with mtx held
+    void rebuild();
+
+    std::mutex mtx;
+    std::uint64_t nextToken = 1;
+    std::vector<std::shared_ptr<const Subscriber> > subscribers;
+    std::vector<const Routes*> retired;         //swapped out, deleted once no hazard points at them
+
+    std::atomic<const Routes*> routes;
+    std::atomic<const Routes*> hazards[hazardSlots];    //the tables publish calls are reading, null for a free slot
+};
+
+#endif /* NotificationBus_h */
@@ -1,11 +1,16 @@
-#include <iostream>
 #include "NymiApi.h"
 #include "GenJson.h"
 #include "Listener.h"
+#include "OutboundQueue.h"
+#include "NymiProvision.h"
+#include "WrapperLog.h"
+#include "Tracing.h"
+#include "Recording.h"
+#include <future>
 
 NymiApi *NymiApi::nApi = nullptr;
 
-NymiApi * NymiApi::getNymiApi(nymi::ConfigOutcome &initResult, errorCallback onError, std::string rootDirectory, nymi::LogLevel log, int nymulatorPort, std::string nymulatorHost) {
+NymiApi * NymiApi::getNymiApi(nymi::ConfigOutcome &initResult, errorCallback onError, const std::string &rootDirectory, nymi::LogLevel log, int nymulatorPort, const std::string &nymulatorHost) {
     
     if (!onError) throw "onError callback is invalid\n";
     
@@ -31,9 +36,21 @@ NymiApi::~NymiApi() {
     if (listener.joinable()) {
         PrivateListener::setQuit(true);
         listener.join();                    //must be joined before calling napiTerminate
+        PrivateListener::setCallbackExecutor(nullptr);
+        callbackExecutor.reset();           //runs the callbacks still queued, which may queue more requests
+        PrivateOutbound::setQuit(true);
+        writer.join();                      //drains queued requests, must be joined before calling napiTerminate
+
+        //last request to napi, nothing is put after it
+        std::string finishMsg = finish();
+        if (PrivateRecord::enabled()) PrivateRecord::record(PrivateRecord::Direction::OUTBOUND, finishMsg, std::chrono::steady_clock::now());
+        nymi::jsonNapiPut(finishMsg);
+        PrivateRecord::stop();
         nymi::jsonNapiTerminate();
 
-        std::cout << "NymiApi terminated\n";
+        NAPICPP_LOG(WrapperLogLevel::info, "NymiApi terminated");
+        PrivateLog::setQuit(true);
+        logWriter.join();                   //last, so everything logged during shutdown is written
     }
 
     nApi = nullptr; //in case we call NymiApi::getNymiApi and need to re-initialize Napi again.
@@ -41,11 +58,16 @@ NymiApi::~NymiApi() {
 
 //public functions
 //----------------
-void NymiApi::init(nymi::ConfigOutcome &initResult, std::string rootDirectory, nymi::LogLevel log, int nymulatorPort, std::string nymulatorHost) {
+void NymiApi::init(nymi::ConfigOutcome &initResult, const std::string &rootDirectory, nymi::LogLevel log, int nymulatorPort, const std::string &nymulatorHost) {
 	
 	initResult = nymi::jsonNapiConfigure(rootDirectory, log, nymulatorPort, nymulatorHost);
 
     if (initResult == nymi::ConfigOutcome::okay) {
+        PrivateListener::setQuit(false);
+        PrivateOutbound::setQuit(false);
+        PrivateLog::setQuit(false);
+        logWriter = std::thread(PrivateLog::writeLogs);
+        writer = std::thread(PrivateOutbound::writeMessages);
         listener = std::thread(PrivateListener::waitForMessage);
     }
 }
@@ -56,18 +78,18 @@ bool NymiApi::startProvisioning(agreementCallback onAgree, newProvisionCallback
     
     PrivateListener::setOnAgreement(onAgree);
     PrivateListener::setOnProvision(onProvision);
-    nymi::jsonNapiPut(start_prov());
+    PrivateOutbound::put(start_prov());
     return true;
 }
 
-void NymiApi::acceptPattern(std::string pattern) {
+void NymiApi::acceptPattern(const std::string &pattern) {
 
-	nymi::jsonNapiPut(accept_pattern(pattern));
+	PrivateOutbound::put(accept_pattern(pattern));
 }
 
 void NymiApi::stopProvisioning() {
 
-	nymi::jsonNapiPut(stop_prov());
+	PrivateOutbound::put(stop_prov());
 }
 
 bool NymiApi::getProvisions(getProvisionsCallback getProvList, ProvisionListType type) {
@@ -77,7 +99,7 @@ bool NymiApi::getProvisions(getProvisionsCallback getProvList, ProvisionListType
     PrivateListener::setProvisionList(getProvList);
 
     std::string exchange = type == ProvisionListType::ALL ? "provisions" : "provisionsPresent";
-    nymi::jsonNapiPut(get_info(exchange));
+    PrivateOutbound::put(get_info(exchange));
     return true;
 }
 
@@ -92,7 +114,7 @@ bool NymiApi::setOnFoundChange(onNymiBandFoundStatusChange onFoundChange) {
 
     if (!onFoundChange) return false;
     
-    nymi::jsonNapiPut(enable_notification(true, "onFoundChange"));
+    PrivateOutbound::put(enable_notification(true, "onFoundChange"));
     PrivateListener::setOnFoundChange(onFoundChange);
     return true;
 }
@@ -101,19 +123,48 @@ bool NymiApi::setOnPresenceChange(onNymiBandPresenceChange onPresenceChange){
     
    	if (!onPresenceChange) return false;
     
-    nymi::jsonNapiPut(enable_notification(true, "onPresenceChange"));
+    PrivateOutbound::put(enable_notification(true, "onPresenceChange"));
     PrivateListener::setOnPresenceChange(onPresenceChange);
     return true;
 }
 
 void NymiApi::disableOnFoundChange(){
     
-    nymi::jsonNapiPut(enable_notification(false,"onFoundChange"));
+    PrivateOutbound::put(enable_notification(false,"onFoundChange"));
 }
 
 void NymiApi::disableOnPresenceChange(){
     
-    nymi::jsonNapiPut(enable_notification(false,"onPresenceChange"));
+    PrivateOutbound::put(enable_notification(false,"onPresenceChange"));
+}
+
+void NymiApi::enableBandStateTracking(){
+    
+    PrivateOutbound::put(enable_notification(true, "onFoundChange"));
+    PrivateOutbound::put(enable_notification(true, "onPresenceChange"));
+}
+
+bool NymiApi::getBandState(const std::string &pid, BandState &state){
+    
+    //a pid no handle was made for has had no notification either, and is not added to the intern table
+    std::uint32_t index;
+    if (NymiProvision::findPid(pid, index) == nullptr) return false;
+    return NymiProvision::bandStates.get(index, state);
+}
+
+std::uint64_t NymiApi::subscribe(bandNotificationCallback onNotification, unsigned kinds, const std::string &pid){
+    
+    std::uint64_t token = PrivateListener::getNotificationBus().subscribe(onNotification, kinds, pid);
+    if (token == 0) return 0;
+    
+    if (kinds & notifyFoundChange) PrivateOutbound::put(enable_notification(true, "onFoundChange"));
+    if (kinds & notifyPresenceChange) PrivateOutbound::put(enable_notification(true, "onPresenceChange"));
+    return token;
+}
+
+bool NymiApi::unsubscribe(std::uint64_t token){
+    
+    return PrivateListener::getNotificationBus().unsubscribe(token);
 }
 
 bool NymiApi::getApiNotificationState(onNotificationsGetState onNotificationsGet){
@@ -121,6 +172,133 @@ bool NymiApi::getApiNotificationState(onNotificationsGetState onNotificationsGet
     if (!onNotificationsGet) return false;
     
     PrivateListener::setOnNotificationsGet(onNotificationsGet);
-    nymi::jsonNapiPut(get_state_notifications());
+    PrivateOutbound::put(get_state_notifications());
+    return true;
+}
+
+bool NymiApi::getAllDeviceInfo(allDeviceInfoCallback onAllDeviceInfo){
+    
+    if (!onAllDeviceInfo) return false;
+    
+    NymiProvision::requestAllDeviceInfo(onAllDeviceInfo);
+    return true;
+}
+
+PrivateOutbound::OutboundStats NymiApi::getOutboundStats(){
+    
+    return PrivateOutbound::getStats();
+}
+
+bool NymiApi::setListenerPollInterval(int minTimeoutMs, int maxTimeoutMs){
+    
+    if (minTimeoutMs <= 0 || maxTimeoutMs < minTimeoutMs) return false;
+    
+    PrivateListener::setPollInterval(minTimeoutMs, maxTimeoutMs);
     return true;
-}
\ No newline at end of file
+}
+
+LatencyHistogram::Snapshot NymiApi::getDispatchLatency(){
+    
+    return PrivateListener::getDispatchLatency();
+}
+
+bool NymiApi::enableCallbackExecutor(unsigned numThreads){
+    
+    if (numThreads == 0 || callbackExecutor) return false;
+    
+    callbackExecutor.reset(new CallbackExecutor(numThreads));
+    PrivateListener::setCallbackExecutor(callbackExecutor.get());
+    return true;
+}
+
+bool NymiApi::getCallbackExecutorStats(CallbackExecutor::Stats &stats){
+    
+    if (!callbackExecutor) return false;
+    
+    stats = callbackExecutor->getStats();
+    return true;
+}
+
+void NymiApi::setDefaultRequestTimeout(std::uint32_t timeoutMs){
+    
+    NymiProvision::defaultTimeoutMs.store(timeoutMs);
+}
+
+std::uint64_t NymiApi::getExpiredRequestCount(){
+    
+    return PrivateListener::getExpiredCount();
+}
+
+std::size_t NymiApi::getPendingRequestCount(){
+    
+    return NymiProvision::nymiProvisions.size();
+}
+
+std::uint64_t NymiApi::getCoalescedDeviceInfoCount(){
+    
+    return NymiProvision::coalescedDeviceInfo.load(std::memory_order_relaxed);
+}
+
+void NymiApi::setWrapperLogLevel(WrapperLogLevel level){
+    
+    PrivateLog::setLevel(level);
+}
+
+void NymiApi::setWrapperLogSink(wrapperLogSink sink){
+    
+    PrivateLog::setSink(sink);
+}
+
+std::uint64_t NymiApi::getDroppedLogCount(){
+    
+    return PrivateLog::getDropped();
+}
+
+MetricsSnapshot NymiApi::getMetrics(){
+    
+    MetricsSnapshot snapshot;
+    PrivateMetrics::snapshotOps(snapshot);
+    snapshot.pendingExchanges = NymiProvision::nymiProvisions.size();
+    snapshot.outboundQueueDepth = PrivateOutbound::getStats().queueDepth;
+    if (callbackExecutor) snapshot.callbackQueueDepth = callbackExecutor->getStats().queued;
+    return snapshot;
+}
+
+bool NymiApi::writeMetrics(const std::string &path){
+    
+    return PrivateMetrics::writePrometheus(getMetrics(), path);
+}
+
+void NymiApi::startTracing(std::size_t maxEvents){
+    
+    PrivateTrace::start(maxEvents);
+}
+
+bool NymiApi::stopTracing(const std::string &path){
+    
+    return PrivateTrace::stop(path);
+}
+
+bool NymiApi::startRecording(const std::string &path){
+    
+    return PrivateRecord::start(path);
+}
+
+void NymiApi::stopRecording(){
+    
+    PrivateRecord::stop();
+}
+
+bool NymiApi::replayRecording(const std::string &path, double speed, std::uint64_t &replayed){
+    
+    //the handlers and the state they update belong to the listener thread, so the replay runs there
+    std::promise<bool> done;
+    std::future<bool> result = done.get_future();
+    std::uint64_t count = 0;
+    bool onListener = PrivateListener::runOnListener([&]{ done.set_value(PrivateRecord::replay(path, speed, count)); });
+    if (!onListener) return PrivateRecord::replay(path, speed, replayed);
+    
+    bool ok = result.get();
+    replayed = count;
+    return ok;
+}
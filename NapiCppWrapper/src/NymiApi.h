@@ -1,8 +1,17 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <thread>
 #include "NeaCallbackTypes.h"
 #include "json-napi.h"
+#include "OutboundQueue.h"
+#include "LatencyHistogram.h"
+#include "CallbackExecutor.h"
+#include "BandStateTable.h"
+#include "NotificationBus.h"
+#include "WrapperLog.h"
+#include "Metrics.h"
 
 class NymiApi {
 
@@ -12,10 +21,10 @@ public:
 
 	enum class ProvisionListType { ALL, PRESENT };
 
-    static NymiApi *getNymiApi(nymi::ConfigOutcome &initResult, errorCallback onError, std::string rootDirectory, nymi::LogLevel log = nymi::LogLevel::normal, int nymulatorPort = -1, std::string nymulatorHost = "");
+    static NymiApi *getNymiApi(nymi::ConfigOutcome &initResult, errorCallback onError, const std::string &rootDirectory, nymi::LogLevel log = nymi::LogLevel::normal, int nymulatorPort = -1, const std::string &nymulatorHost = "");
 	
 	bool startProvisioning(agreementCallback onPattern, newProvisionCallback onProvision);
-	void acceptPattern(std::string pattern);
+	void acceptPattern(const std::string &pattern);
 	void stopProvisioning();
 	bool getProvisions(getProvisionsCallback getProvList, ProvisionListType type);
     bool setOnProvisionModeChange(onStartStopProvisioning onProvisionModeChange);
@@ -24,8 +33,77 @@ public:
     bool setOnPresenceChange(onNymiBandPresenceChange onPresenceChange);
     void disableOnFoundChange();
     void disableOnPresenceChange();
+
+    //turns on the found-change and presence-change notifications that keep NymiProvision::getBandState current,
+    //without setting callbacks for them. disableOnFoundChange and disableOnPresenceChange turn them off again
+    void enableBandStateTracking();
+    bool getBandState(const std::string &pid, BandState &state);
+
+    //any number of subscribers can receive the found-change and presence-change notifications, alongside the
+    //callbacks of setOnFoundChange and setOnPresenceChange. kinds is a mask of notifyFoundChange and notifyPresenceChange,
+    //an empty pid subscribes to every band. subscribing turns the notifications on in napi.
+    //returns the token for unsubscribe, 0 if the arguments are invalid.
+    std::uint64_t subscribe(bandNotificationCallback onNotification, unsigned kinds = notifyAll, const std::string &pid = "");
+    bool unsubscribe(std::uint64_t token);
     bool getApiNotificationState(onNotificationsGetState onNotificationsGet);
 
+    //device info of every band napi knows of, keyed by pid, from a single info request.
+    //shares the request with NymiProvision::getDeviceInfo calls in flight
+    bool getAllDeviceInfo(allDeviceInfoCallback onAllDeviceInfo);
+
+    //requests are handed to napi by NymiApi::writer, this reports how far behind it is
+    PrivateOutbound::OutboundStats getOutboundStats();
+
+    //the listener waits on napi for minTimeoutMs after a message, doubling up to maxTimeoutMs while idle.
+    //shutdown does not wait out the timeout. defaults are 10ms and 250ms.
+    bool setListenerPollInterval(int minTimeoutMs, int maxTimeoutMs);
+    LatencyHistogram::Snapshot getDispatchLatency();
+
+    //by default NEA callbacks run on the listener thread, so a slow callback delays every other band.
+    //once enabled, callbacks run on numThreads worker threads; callbacks for the same pid still run one
+    //at a time, in the order napi reported them. can be enabled once, for the lifetime of the NymiApi.
+    bool enableCallbackExecutor(unsigned numThreads);
+    bool getCallbackExecutorStats(CallbackExecutor::Stats &stats);
+
+    //requests on a NymiProvision that napi has not answered within timeoutMs fail with a "timeout" error.
+    //applies to requests made after the call, through handles without their own NymiProvision::setRequestTimeout.
+    //0 disables the deadline. default is 30s.
+    void setDefaultRequestTimeout(std::uint32_t timeoutMs);
+    std::uint64_t getExpiredRequestCount();
+    std::size_t getPendingRequestCount();
+
+    //NymiProvision::getDeviceInfo and getAllDeviceInfo calls that joined an info request already in flight instead of sending their own
+    std::uint64_t getCoalescedDeviceInfoCount();
+
+    //request counts, errors, timeouts and latency per operation, and the depth of the wrapper's queues
+    MetricsSnapshot getMetrics();
+    //writes getMetrics() to path in the Prometheus text format, e.g. for the node exporter's textfile collector
+    bool writeMetrics(const std::string &path);
+
+    //records a span per request made on a NymiProvision, from being queued through jsonNapiPut, receipt, parse
+    //and handler to the callback returning. stopTracing writes them to path as Chrome trace events (chrome://tracing, Perfetto).
+    //events past maxEvents are dropped. while not tracing, each stage costs one relaxed atomic load
+    void startTracing(std::size_t maxEvents = 1000000);
+    bool stopTracing(const std::string &path);
+
+    //writes every json passed to jsonNapiPut and received from jsonNapiGet to path, with the time it went by.
+    //the recording holds key material in the clear, keep it where the keys could be kept
+    bool startRecording(const std::string &path);
+    void stopRecording();
+    //dispatches the napi messages of a recording as if napi had just sent them, at speed times the recorded pace
+    //(0 for as fast as possible). responses only reach a callback if a request with the same exchange is pending,
+    //so replay is for reproducing notifications and timing the parse and dispatch path.
+    //the replay runs on the listener thread and returns once it is done; napi messages wait until then.
+    //do not call it from a callback that runs on the listener thread
+    bool replayRecording(const std::string &path, double speed, std::uint64_t &replayed);
+
+    //the wrapper's own log, separate from napi's. records above level are discarded where they are logged,
+    //the rest are redacted of key material and written by NymiApi::logWriter, to std::clog unless a sink is set.
+    //default level is warning. levels above NAPICPP_MAX_LOG_LEVEL are compiled out
+    void setWrapperLogLevel(WrapperLogLevel level);
+    void setWrapperLogSink(wrapperLogSink sink);
+    std::uint64_t getDroppedLogCount();
+
 private:
 
 	//initialization and singleton pattern
@@ -34,8 +112,14 @@ private:
 	NymiApi(NymiApi &dontAllowCopy) { /*intentionally empty*/ }
     NymiApi(NymiApi &&dontAllowMove) { /*intentionally empty*/ }
 
-	void init(nymi::ConfigOutcome &initResult, std::string rootDirectory, nymi::LogLevel log, int nymulatorPort = -1, std::string nymulatorHost = "");
+	void init(nymi::ConfigOutcome &initResult, const std::string &rootDirectory, nymi::LogLevel log, int nymulatorPort = -1, const std::string &nymulatorHost = "");
 
 	//receive json communication from napi
 	std::thread listener;
+	//send json communication to napi
+	std::thread writer;
+	//write the wrapper's log
+	std::thread logWriter;
+	//optional, runs NEA callbacks off the listener thread
+	std::unique_ptr<CallbackExecutor> callbackExecutor;
 };
\ No newline at end of file
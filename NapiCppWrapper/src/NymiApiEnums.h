@@ -41,7 +41,7 @@ const std::map<std::string,PresenceStatus> presentEnum = {
 };
 
 //utility functions
-inline FoundStatus stringToFoundStatus(std::string foundStr){
+inline FoundStatus stringToFoundStatus(const std::string &foundStr){
     auto it = foundEnum.find(foundStr);
     if (it != foundEnum.end()){
         return it->second;
@@ -49,7 +49,7 @@ inline FoundStatus stringToFoundStatus(std::string foundStr){
     return FoundStatus::ERROR;
 }
 
-inline PresenceStatus stringToPresenceStatus(std::string presStr){
+inline PresenceStatus stringToPresenceStatus(const std::string &presStr){
     auto it = presentEnum.find(presStr);
     if (it != presentEnum.end()){
         return it->second;
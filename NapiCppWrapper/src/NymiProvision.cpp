@@ -7,29 +7,96 @@
 //
 
 #include "NymiProvision.h"
-#include "json-napi.h"
+#include "OutboundQueue.h"
 #include "GenJson.h"
-#include <random>
+#include "WrapperLog.h"
+#include "Metrics.h"
+#include "Tracing.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
-static std::mt19937 rng;
-static std::uniform_int_distribution<std::mt19937::result_type> dist(0, 9999);
-void seed_random(){ rng.seed(std::random_device()()); }
+//every request in flight carries one of these, see NeaCallback
+static_assert(sizeof(NymiProvision::NeaCallback) <= sizeof(randomCallback) + alignof(randomCallback), "a NeaCallback holds one std::function and its kind");
 
-std::map<std::string, NymiProvision::NeaCallback> NymiProvision::nymiProvisions = std::map<std::string, NymiProvision::NeaCallback>();
+ExchangeRegistry<NymiProvision::PendingExchange> NymiProvision::nymiProvisions;
+TimerWheel NymiProvision::deadlines;
+BandStateTable NymiProvision::bandStates;
+std::atomic<std::uint32_t> NymiProvision::defaultTimeoutMs{ 30000 };
+std::atomic<std::uint64_t> NymiProvision::coalescedDeviceInfo{ 0 };
 
-NymiProvision::NymiProvision() { seed_random(); }
-NymiProvision::NymiProvision(const NymiProvision &other) :m_pid(other.getPid()) { seed_random(); }
-NymiProvision::NymiProvision(std::string pid):m_pid(pid) { seed_random(); }
+//registers the callback for a new request on pid, and returns the exchange to send to napi with it, see ExchangeId::str.
+//the deadline is set before the request is queued, so the response cannot be taken before it exists
+static ExchangeId newExchange(ExchangeOp op, const std::string *pid, NymiProvision::NeaCallback callback, std::uint32_t timeoutMs){
+
+    NymiProvision::PendingExchange pending;
+    pending.pid = pid;
+    pending.callback = std::move(callback);
+    pending.issued = std::chrono::steady_clock::now();
+    ExchangeId id = NymiProvision::nymiProvisions.insert(op, std::move(pending));
+    PrivateMetrics::recordRequest(op);
+
+    if (timeoutMs > 0) NymiProvision::deadlines.schedule(id, timeoutMs);
+    if (PrivateTrace::enabled()) PrivateTrace::begin(id.seq, op);
+    return id;
+}
+
+//elements of an unordered_map are never moved by rehashing, so pointers to them stay valid.
+//each pid also gets a dense index, in order of first use, see bandStates
+struct PidTable {
+    std::mutex mtx;
+    std::unordered_map<std::string, std::uint32_t> pids;
+};
+
+//constructed on first use, handles may be made during static initialization
+static PidTable &pidTable(){
+
+    static PidTable table;
+    return table;
+}
+
+const std::string *NymiProvision::internPid(const std::string &pid, std::uint32_t &index){
+
+    PidTable &table = pidTable();
+    std::lock_guard<std::mutex> lock(table.mtx);
+    auto it = table.pids.find(pid);
+    if (it == table.pids.end()) it = table.pids.emplace(pid, static_cast<std::uint32_t>(table.pids.size())).first;
+    index = it->second;
+    return &it->first;
+}
+
+const std::string *NymiProvision::findPid(const std::string &pid, std::uint32_t &index){
+
+    PidTable &table = pidTable();
+    std::lock_guard<std::mutex> lock(table.mtx);
+    auto it = table.pids.find(pid);
+    if (it == table.pids.end()) return nullptr;
+    index = it->second;
+    return &it->first;
+}
+
+NymiProvision::NymiProvision() :m_timeoutMs(0) { m_pid = internPid("", m_index); }
+NymiProvision::NymiProvision(const std::string &pid) :m_timeoutMs(0) { m_pid = internPid(pid, m_index); }
+
+bool NymiProvision::getBandState(BandState &state) const {
+
+    return bandStates.get(m_index, state);
+}
+
+std::uint32_t NymiProvision::requestTimeout() const {
+
+    return m_timeoutMs > 0 ? m_timeoutMs : defaultTimeoutMs.load(std::memory_order_relaxed);
+}
 
 bool NymiProvision::getRandom(randomCallback onRandom){
     
     if (!onRandom) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "random" + getPid();
-    nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onRandom)));
-    nymi::jsonNapiPut(get_random(getPid(),exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::RANDOM, m_pid, NymiProvision::NeaCallback(onRandom), requestTimeout());
+    PrivateOutbound::put(get_random(getPid(),exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
@@ -37,12 +104,10 @@ bool NymiProvision::createSymmetricKey(bool guarded, createdKeyCallback onCreate
     
     if (!onCreatedKey) return false;
     
-    std::string exchange = std::to_string(dist(rng));
-    exchange += "createsymkey" + getPid();
-    nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onCreatedKey)));
-    std::string createsk = create_symkey(getPid(),guarded,exchange);
-    std::cout<<"sending msg: "<<createsk<<std::endl;
-    nymi::jsonNapiPut(createsk);
+    ExchangeId exchange = newExchange(ExchangeOp::CREATE_SYMMETRIC_KEY, m_pid, NymiProvision::NeaCallback(onCreatedKey), requestTimeout());
+    std::string createsk = create_symkey(getPid(),guarded,exchange.str());
+    NAPICPP_LOG(WrapperLogLevel::debug, "sending msg: " << createsk);
+    PrivateOutbound::put(std::move(createsk), m_pid, exchange.seq);
     return true;
 }
 
@@ -50,32 +115,26 @@ bool NymiProvision::getSymmetricKey(symmetricKeyCallback onSymmetric) {
 
     if (!onSymmetric) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "getsymkey" + getPid();
-	nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onSymmetric)));
-	nymi::jsonNapiPut(get_symkey(getPid(),exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::GET_SYMMETRIC_KEY, m_pid, NymiProvision::NeaCallback(onSymmetric), requestTimeout());
+	PrivateOutbound::put(get_symkey(getPid(),exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
-bool NymiProvision::signMessage(std::string msghash, ecdsaSignCallback onMessageSigned) {
+bool NymiProvision::signMessage(const std::string &msghash, ecdsaSignCallback onMessageSigned) {
 
     if (!onMessageSigned) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "sign" + getPid();
-	nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onMessageSigned)));
-	nymi::jsonNapiPut(sign_msg(getPid(), msghash, exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::SIGN, m_pid, NymiProvision::NeaCallback(onMessageSigned), requestTimeout());
+	PrivateOutbound::put(sign_msg(getPid(), msghash, exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
-bool NymiProvision::createTotpKey(std::string totpKey, bool guarded, createdKeyCallback onCreatedKey) {
+bool NymiProvision::createTotpKey(const std::string &totpKey, bool guarded, createdKeyCallback onCreatedKey) {
 
     if (!onCreatedKey) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "createTotp" + getPid();
-	nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onCreatedKey)));
-	nymi::jsonNapiPut(set_totp(getPid(),totpKey,guarded,exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::CREATE_TOTP, m_pid, NymiProvision::NeaCallback(onCreatedKey), requestTimeout());
+	PrivateOutbound::put(set_totp(getPid(),totpKey,guarded,exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
@@ -83,10 +142,8 @@ bool NymiProvision::getTotpKey(totpGetCallback onTotpGet) {
 
     if (!onTotpGet) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "getTotp" + getPid();
-	nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onTotpGet)));
-	nymi::jsonNapiPut(get_totp(getPid(), exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::GET_TOTP, m_pid, NymiProvision::NeaCallback(onTotpGet), requestTimeout());
+	PrivateOutbound::put(get_totp(getPid(), exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
@@ -94,21 +151,176 @@ bool NymiProvision::sendNotification(HapticNotification notifyType, onNotificati
 
     if (!onNotified) return false;
     
-	std::string exchange = std::to_string(dist(rng));
-	exchange += "notify" + getPid();
-	nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onNotified)));
-	nymi::jsonNapiPut(notify(getPid(), notifyType == HapticNotification::NOTIFY_POSITIVE, exchange));
+	ExchangeId exchange = newExchange(ExchangeOp::NOTIFY, m_pid, NymiProvision::NeaCallback(onNotified), requestTimeout());
+	PrivateOutbound::put(notify(getPid(), notifyType == HapticNotification::NOTIFY_POSITIVE, exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
+//callers waiting on the info request in flight, if there is one, each with its own deadline
+using steadyClock = std::chrono::steady_clock;
+
+struct InfoWaiter {
+    deviceInfoCallback callback;
+    steadyClock::time_point deadline;
+};
+
+struct AllInfoWaiter {
+    allDeviceInfoCallback callback;
+    steadyClock::time_point deadline;
+};
+
+static std::mutex infoFlightMtx;
+static bool infoInFlight = false;
+static std::unordered_map<const std::string*, std::vector<InfoWaiter> > infoWaiters;
+static std::vector<AllInfoWaiter> allInfoWaiters;
+
+static void issueInfoRequest(std::uint32_t timeoutMs);
+
+//timeoutMs 0 is no deadline
+static steadyClock::time_point infoDeadline(std::uint32_t timeoutMs){
+
+    if (timeoutMs == 0) return steadyClock::time_point::max();
+    return steadyClock::now() + std::chrono::milliseconds(timeoutMs);
+}
+
+//the error Listener's expireRequests fails a request with
+static bool isTimeout(const napiError &nErr){
+
+    for (auto &err : nErr.errorList) {
+        if (err.second == "timeout") return true;
+    }
+    return false;
+}
+
+//hands the bands decoded from one info response to everyone who asked while it was in flight.
+//if the request timed out, the waiters that joined it later and still have time left are carried over to a new
+//request, with the latest of their deadlines, rather than failing on the deadline of the caller that sent it
+static void completeInfoFlight(bool opResult, std::map<std::string,TransientNymiBandInfo> &infoByPid, const napiError &nErr){
+
+    std::unordered_map<const std::string*, std::vector<InfoWaiter> > waiters;
+    std::vector<AllInfoWaiter> allWaiters;
+    bool reissue = false;
+    std::uint32_t reissueMs = 0;
+    {
+        std::lock_guard<std::mutex> lock(infoFlightMtx);
+        waiters.swap(infoWaiters);
+        allWaiters.swap(allInfoWaiters);
+        infoInFlight = false;
+
+        if (!opResult && isTimeout(nErr)) {
+
+            steadyClock::time_point now = steadyClock::now();
+            steadyClock::time_point latest = now;
+            auto carryOver = [&](const steadyClock::time_point &deadline){
+                if (deadline <= now) return false;
+                latest = std::max(latest, deadline);
+                return true;
+            };
+
+            for (auto it = allWaiters.begin(); it != allWaiters.end(); ) {
+                if (carryOver(it->deadline)) { allInfoWaiters.push_back(std::move(*it)); it = allWaiters.erase(it); }
+                else ++it;
+            }
+            for (auto &pidWaiters : waiters) {
+                auto &pending = pidWaiters.second;
+                for (auto it = pending.begin(); it != pending.end(); ) {
+                    if (carryOver(it->deadline)) { infoWaiters[pidWaiters.first].push_back(std::move(*it)); it = pending.erase(it); }
+                    else ++it;
+                }
+            }
+
+            if (!allInfoWaiters.empty() || !infoWaiters.empty()) {
+                infoInFlight = reissue = true;
+                if (latest != steadyClock::time_point::max()) {
+                    reissueMs = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(latest - now).count() + 1);
+                }
+            }
+        }
+    }
+    if (reissue) issueInfoRequest(reissueMs);
+
+    //each callback gets its own copy of what it is passed, so one modifying it does not change what the next one
+    //reads. the bands are handed out first, then the map, and the last reader of the map gets infoByPid itself.
+    //callbacks asking for device info again join the new request, or start one
+    for (auto &pidWaiters : waiters) {
+
+        const std::string &pid = *pidWaiters.first;
+        auto it = opResult ? infoByPid.find(pid) : infoByPid.end();
+
+        if (it == infoByPid.end()) {
+            napiError missing = nErr;
+            if (opResult) missing = { "Could not find JSON field \"response/provisionMap/" + pid + "\" in the info response", {} };
+            for (auto &waiter : pidWaiters.second) {
+                TransientNymiBandInfo blank;
+                waiter.callback(false, pid, blank, missing);
+            }
+        }
+        else {
+            for (auto &waiter : pidWaiters.second) {
+                TransientNymiBandInfo info = it->second;
+                waiter.callback(true, pid, info, nErr);
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < allWaiters.size(); ++i) {
+        if (i + 1 == allWaiters.size()) {
+            allWaiters[i].callback(opResult, infoByPid, nErr);
+        }
+        else {
+            std::map<std::string,TransientNymiBandInfo> copy = infoByPid;
+            allWaiters[i].callback(opResult, copy, nErr);
+        }
+    }
+}
+
+//sends the info request all the waiters share
+static void issueInfoRequest(std::uint32_t timeoutMs){
+
+    allDeviceInfoCallback onFlightDone = [](bool opResult, std::map<std::string,TransientNymiBandInfo> &infoByPid, const napiError &nErr){
+        completeInfoFlight(opResult, infoByPid, nErr);
+    };
+
+    //the request is not about a single band, it is registered on the empty pid
+    static const std::string *noPid = &NymiProvision().getPid();
+    ExchangeId exchange = newExchange(ExchangeOp::DEVICE_INFO, noPid, NymiProvision::NeaCallback(onFlightDone), timeoutMs);
+    PrivateOutbound::put(get_info(exchange.str()), nullptr, exchange.seq);
+}
+
+void NymiProvision::requestAllDeviceInfo(allDeviceInfoCallback onAllDeviceInfo){
+
+    std::uint32_t timeoutMs = defaultTimeoutMs.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(infoFlightMtx);
+        allInfoWaiters.push_back(AllInfoWaiter{ std::move(onAllDeviceInfo), infoDeadline(timeoutMs) });
+        if (infoInFlight) {
+            coalescedDeviceInfo.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        infoInFlight = true;
+    }
+
+    issueInfoRequest(timeoutMs);
+}
+
 bool NymiProvision::getDeviceInfo(deviceInfoCallback onDeviceInfo){
     
     if (!onDeviceInfo) return false;
     
-    std::string exchange = std::to_string(dist(rng));
-    exchange += "deviceinfo" + getPid();
-    nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onDeviceInfo)));
-    nymi::jsonNapiPut(get_info(exchange));
+    //single flight: while an info request is in flight, later callers wait for its result.
+    //if it times out before their own deadline, completeInfoFlight sends another one for them
+    std::uint32_t timeoutMs = requestTimeout();
+    {
+        std::lock_guard<std::mutex> lock(infoFlightMtx);
+        infoWaiters[m_pid].push_back(InfoWaiter{ std::move(onDeviceInfo), infoDeadline(timeoutMs) });
+        if (infoInFlight) {
+            coalescedDeviceInfo.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        infoInFlight = true;
+    }
+    
+    issueInfoRequest(timeoutMs);
     return true;
 }
 
@@ -116,10 +328,6 @@ bool NymiProvision::revokeKey(KeyType keyType, revokedKeyCallback onRevokeKey){
 
     if (!onRevokeKey) return false;
 
-    std::string exchange = std::to_string(dist(rng));
-    exchange += "deviceinfo" + getPid();
-    nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onRevokeKey)));
-
     std::string keyStr;
     switch(keyType) {
         case KeyType::SYMMETRIC: keyStr = "symmetric"; break;
@@ -127,7 +335,9 @@ bool NymiProvision::revokeKey(KeyType keyType, revokedKeyCallback onRevokeKey){
         default: return false;
     }
 
-    nymi::jsonNapiPut(delete_key(getPid(),keyStr,exchange));
+    ExchangeId exchange = newExchange(ExchangeOp::REVOKE_KEY, m_pid, NymiProvision::NeaCallback(onRevokeKey), requestTimeout());
+
+    PrivateOutbound::put(delete_key(getPid(),keyStr,exchange.str()), m_pid, exchange.seq);
     return true;
 }
 
@@ -135,9 +345,60 @@ bool NymiProvision::revokeProvision(bool onlyIfAuthenticated, onProvisionRevoked
 
     if (!onProvRevoked) return false;
 
-    std::string exchange = std::to_string(dist(rng));
-    exchange += "revokeprovision" + getPid();
-    nymiProvisions.insert(std::make_pair(exchange, NymiProvision::NeaCallback(onProvRevoked)));
-    nymi::jsonNapiPut(revoke_provision(getPid(),onlyIfAuthenticated,exchange));
+    ExchangeId exchange = newExchange(ExchangeOp::REVOKE_PROVISION, m_pid, NymiProvision::NeaCallback(onProvRevoked), requestTimeout());
+    PrivateOutbound::put(revoke_provision(getPid(),onlyIfAuthenticated,exchange.str()), m_pid, exchange.seq);
     return true;
-}
\ No newline at end of file
+}
+
+//future overloads
+//----------------
+template <typename T>
+using resultPromise = std::shared_ptr<std::promise<NapiResult<T> > >;
+
+template <typename T>
+static resultPromise<T> newResultPromise(){ return std::make_shared<std::promise<NapiResult<T> > >(); }
+
+std::future<NapiResult<std::string> > NymiProvision::getRandom(){
+
+    auto promise = newResultPromise<std::string>();
+    getRandom([promise](bool opResult, const std::string &pid, const std::string &rand, const napiError &err){
+        promise->set_value(NapiResult<std::string>{ opResult, pid, rand, err });
+    });
+    return promise->get_future();
+}
+
+std::future<NapiResult<std::string> > NymiProvision::getSymmetricKey(){
+
+    auto promise = newResultPromise<std::string>();
+    getSymmetricKey([promise](bool opResult, const std::string &pid, const std::string &sk, const napiError &err){
+        promise->set_value(NapiResult<std::string>{ opResult, pid, sk, err });
+    });
+    return promise->get_future();
+}
+
+std::future<NapiResult<EcdsaSignature> > NymiProvision::signMessage(const std::string &msghash){
+
+    auto promise = newResultPromise<EcdsaSignature>();
+    signMessage(msghash, [promise](bool opResult, const std::string &pid, const std::string &sig, const std::string &vk, const napiError &err){
+        promise->set_value(NapiResult<EcdsaSignature>{ opResult, pid, EcdsaSignature{ sig, vk }, err });
+    });
+    return promise->get_future();
+}
+
+std::future<NapiResult<std::string> > NymiProvision::getTotpKey(){
+
+    auto promise = newResultPromise<std::string>();
+    getTotpKey([promise](bool opResult, const std::string &pid, const std::string &totp, const napiError &err){
+        promise->set_value(NapiResult<std::string>{ opResult, pid, totp, err });
+    });
+    return promise->get_future();
+}
+
+std::future<NapiResult<TransientNymiBandInfo> > NymiProvision::getDeviceInfo(){
+
+    auto promise = newResultPromise<TransientNymiBandInfo>();
+    getDeviceInfo([promise](bool opResult, const std::string &pid, TransientNymiBandInfo &info, const napiError &err){
+        promise->set_value(NapiResult<TransientNymiBandInfo>{ opResult, pid, info, err });
+    });
+    return promise->get_future();
+}
@@ -9,78 +9,204 @@
 #ifndef NymiProvision_hpp
 #define NymiProvision_hpp
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <future>
 #include <string>
 #include <map>
+#include <new>
+#include <type_traits>
+#include <utility>
 #include "NeaCallbackTypes.h"
+#include "TransientNymiBandInfo.h"
+#include "ExchangeRegistry.h"
+#include "TimerWheel.h"
+#include "BandStateTable.h"
 
 class NymiProvision {
     
     friend class NymiApi;
+    friend class NotificationBus;
 
 public:
     
+    //a NymiProvision is a handle to an interned pid: copying or moving one is a pointer copy.
+    //constructing one from a pid looks it up in the intern table under one process-wide mutex, and adds it
+    //if it is new. pids are never removed, so the table only grows, by one entry per distinct pid seen
     NymiProvision();
-    NymiProvision(const NymiProvision &other);
-    NymiProvision(std::string pid);
+    NymiProvision(const std::string &pid);
+    NymiProvision(const NymiProvision &other) = default;
+    NymiProvision &operator=(const NymiProvision &other) = default;
     
-    inline std::string getPid() const { return m_pid; }
+    inline const std::string &getPid() const { return *m_pid; }
+
+    //deadline for the requests made through this handle. if napi has not answered by then, the callback is
+    //called with a timeout error. 0, the default, uses NymiApi::setDefaultRequestTimeout
+    inline void setRequestTimeout(std::uint32_t timeoutMs) { m_timeoutMs = timeoutMs; }
+    inline std::uint32_t getRequestTimeout() const { return m_timeoutMs; }
+
+    //found and presence state of the band as of the last found-change and presence-change notifications,
+    //without a request to napi. wait-free. returns false until a notification about this band was received,
+    //see NymiApi::enableBandStateTracking
+    bool getBandState(BandState &state) const;
 
     bool getRandom(randomCallback onRandom);
     bool createSymmetricKey(bool guarded, createdKeyCallback onCreatedKey);
 	bool getSymmetricKey(symmetricKeyCallback onSymmetric);
-	bool signMessage(std::string message, ecdsaSignCallback onMessageSigned);
-	bool createTotpKey(std::string totpKey, bool guarded, createdKeyCallback onCreatedKey);
+	bool signMessage(const std::string &message, ecdsaSignCallback onMessageSigned);
+	bool createTotpKey(const std::string &totpKey, bool guarded, createdKeyCallback onCreatedKey);
 	bool getTotpKey(totpGetCallback onTotpGet);
 	bool sendNotification(HapticNotification notifyType, onNotificationCallback onNotified);
     bool getDeviceInfo(deviceInfoCallback onDeviceInfo);
     bool revokeKey(KeyType keyType, revokedKeyCallback onRevokedKey);
     bool revokeProvision(bool only_if_authenticated, onProvisionRevokedCallback onProvRevoked);
 
+    //same operations, the result is delivered through the returned future instead of a callback.
+    //the future becomes ready on the thread that runs NEA callbacks, so do not wait on it from a callback.
+    std::future<NapiResult<std::string> > getRandom();
+    std::future<NapiResult<std::string> > getSymmetricKey();
+    std::future<NapiResult<EcdsaSignature> > signMessage(const std::string &message);
+    std::future<NapiResult<std::string> > getTotpKey();
+    std::future<NapiResult<TransientNymiBandInfo> > getDeviceInfo();
+
 private:
     
-    std::string m_pid;
+    //points into a process-wide table of pids, entries live for the lifetime of the process
+    const std::string *m_pid;
+    std::uint32_t m_index;      //dense index of the pid, see bandStates
+    std::uint32_t m_timeoutMs;
+
+    //deadline of requests made through handles without their own, 0 for no deadline
+    static std::atomic<std::uint32_t> defaultTimeoutMs;
+
+    //getDeviceInfo and NymiApi::getAllDeviceInfo calls answered by a request already in flight
+    static std::atomic<std::uint64_t> coalescedDeviceInfo;
+
+    static const std::string *internPid(const std::string &pid, std::uint32_t &index);
+
+    //as internPid, without adding pid. returns nullptr if no handle was ever made for it
+    static const std::string *findPid(const std::string &pid, std::uint32_t &index);
 
+    std::uint32_t requestTimeout() const;
+
+    //every info/get answers for all bands, so getDeviceInfo and NymiApi::getAllDeviceInfo share one request in flight
+    static void requestAllDeviceInfo(allDeviceInfoCallback onAllDeviceInfo);
+
+public:
+
+	//the callback of one request in flight. Only one callback type is ever set, so they share the storage of a union
+	//and a NeaCallback is the size of one std::function and its kind. A callable small enough for the std::function
+	//is stored inline, others are moved from the std::function the NEA passed, so registering one does not allocate
 	class NeaCallback {
 
-        //maybe a structure such as a union would be better suited here
-        std::function<void(bool, std::string, napiError)> fn1;
-		std::function<void(bool, std::string,std::string, napiError)> fn2;
-		std::function<void(bool, std::string,std::string, std::string, napiError)> fn3;
-		std::function<void(bool, std::string,HapticNotification, napiError)> fn4;
-        std::function<void(bool, std::string,TransientNymiBandInfo&, napiError)> fn5;
-        std::function<void(bool, std::string, KeyType, napiError)> fn6;
+        enum class Kind : std::uint8_t { NONE, PROVISION_REVOKED, VALUE, SIGN, NOTIFIED, DEVICE_INFO, KEY, ALL_DEVICE_INFO };
+
+        Kind kind;
+        union {
+            onProvisionRevokedCallback fn1;
+            randomCallback fn2;             //also symmetricKeyCallback and totpGetCallback, the same type
+            ecdsaSignCallback fn3;
+            onNotificationCallback fn4;
+            deviceInfoCallback fn5;
+            createdKeyCallback fn6;         //also revokedKeyCallback
+            allDeviceInfoCallback fn7;
+        };
+
+        //other is a const NeaCallback& to copy from, or a NeaCallback&& to move from. this holds nothing
+        template <typename Other>
+        void assign(Other &&other) {
+            switch (other.kind) {
+                case Kind::PROVISION_REVOKED: new (&fn1) onProvisionRevokedCallback(std::forward<Other>(other).fn1); break;
+                case Kind::VALUE: new (&fn2) randomCallback(std::forward<Other>(other).fn2); break;
+                case Kind::SIGN: new (&fn3) ecdsaSignCallback(std::forward<Other>(other).fn3); break;
+                case Kind::NOTIFIED: new (&fn4) onNotificationCallback(std::forward<Other>(other).fn4); break;
+                case Kind::DEVICE_INFO: new (&fn5) deviceInfoCallback(std::forward<Other>(other).fn5); break;
+                case Kind::KEY: new (&fn6) createdKeyCallback(std::forward<Other>(other).fn6); break;
+                case Kind::ALL_DEVICE_INFO: new (&fn7) allDeviceInfoCallback(std::forward<Other>(other).fn7); break;
+                case Kind::NONE: break;
+            }
+            kind = other.kind;
+        }
+
+        void reset() {
+            switch (kind) {
+                case Kind::PROVISION_REVOKED: fn1.~onProvisionRevokedCallback(); break;
+                case Kind::VALUE: fn2.~randomCallback(); break;
+                case Kind::SIGN: fn3.~ecdsaSignCallback(); break;
+                case Kind::NOTIFIED: fn4.~onNotificationCallback(); break;
+                case Kind::DEVICE_INFO: fn5.~deviceInfoCallback(); break;
+                case Kind::KEY: fn6.~createdKeyCallback(); break;
+                case Kind::ALL_DEVICE_INFO: fn7.~allDeviceInfoCallback(); break;
+                case Kind::NONE: break;
+            }
+            kind = Kind::NONE;
+        }
 
 	public:
-		NeaCallback(std::function<void(bool, std::string, napiError)> _fn) :fn1(_fn) {}
-		NeaCallback(std::function<void(bool, std::string, std::string, napiError)> _fn) :fn2(_fn) {}
-		NeaCallback(std::function<void(bool, std::string, std::string, std::string, napiError)> _fn) :fn3(_fn) {}
-		NeaCallback(std::function<void(bool, std::string, HapticNotification, napiError)> _fn) :fn4(_fn) {}
-        NeaCallback(std::function<void(bool, std::string, TransientNymiBandInfo&, napiError)> _fn) :fn5(_fn) {}
-        NeaCallback(std::function<void(bool, std::string, KeyType, napiError)> _fn) :fn6(_fn) {}
-
-		void operator()(bool arg1, std::string arg2, napiError arg3) {
-			if (fn1) fn1(arg1,arg2,arg3);
+		NeaCallback() :kind(Kind::NONE) {}
+		NeaCallback(onProvisionRevokedCallback _fn) :kind(Kind::PROVISION_REVOKED), fn1(std::move(_fn)) {}
+		NeaCallback(randomCallback _fn) :kind(Kind::VALUE), fn2(std::move(_fn)) {}
+		NeaCallback(ecdsaSignCallback _fn) :kind(Kind::SIGN), fn3(std::move(_fn)) {}
+		NeaCallback(onNotificationCallback _fn) :kind(Kind::NOTIFIED), fn4(std::move(_fn)) {}
+        NeaCallback(deviceInfoCallback _fn) :kind(Kind::DEVICE_INFO), fn5(std::move(_fn)) {}
+        NeaCallback(createdKeyCallback _fn) :kind(Kind::KEY), fn6(std::move(_fn)) {}
+        NeaCallback(allDeviceInfoCallback _fn) :kind(Kind::ALL_DEVICE_INFO), fn7(std::move(_fn)) {}
+
+        NeaCallback(const NeaCallback &other) :kind(Kind::NONE) { assign(other); }
+        NeaCallback(NeaCallback &&other) noexcept :kind(Kind::NONE) { assign(std::move(other)); }
+        NeaCallback &operator=(const NeaCallback &other) {
+            if (this != &other) { reset(); assign(other); }
+            return *this;
+        }
+        NeaCallback &operator=(NeaCallback &&other) noexcept {
+            if (this != &other) { reset(); assign(std::move(other)); }
+            return *this;
+        }
+        ~NeaCallback() { reset(); }
+
+		void operator()(bool arg1, const std::string &arg2, const napiError &arg3) {
+			if (kind == Kind::PROVISION_REVOKED && fn1) fn1(arg1,arg2,arg3);
 		}
-		void operator()(bool arg1, std::string arg2,std::string arg3, napiError arg4) {
-			if (fn2) fn2(arg1, arg2,arg3,arg4);
+		void operator()(bool arg1, const std::string &arg2, const std::string &arg3, const napiError &arg4) {
+			if (kind == Kind::VALUE && fn2) fn2(arg1, arg2,arg3,arg4);
 		}
-		void operator()(bool arg1, std::string arg2,std::string arg3, std::string arg4, napiError arg5) {
-			if (fn3) fn3(arg1,arg2,arg3,arg4,arg5);
+		void operator()(bool arg1, const std::string &arg2, const std::string &arg3, const std::string &arg4, const napiError &arg5) {
+			if (kind == Kind::SIGN && fn3) fn3(arg1,arg2,arg3,arg4,arg5);
 		}
-		void operator()(bool arg1, std::string arg2, HapticNotification arg3, napiError arg4) {
-			if (fn4) fn4(arg1,arg2,arg3,arg4);
+		void operator()(bool arg1, const std::string &arg2, HapticNotification arg3, const napiError &arg4) {
+			if (kind == Kind::NOTIFIED && fn4) fn4(arg1,arg2,arg3,arg4);
 		}
-        void operator()(bool arg1, std::string arg2,TransientNymiBandInfo &arg3, napiError arg4) {
-            if (fn5) fn5(arg1,arg2,arg3,arg4);
+        void operator()(bool arg1, const std::string &arg2, TransientNymiBandInfo &arg3, const napiError &arg4) {
+            if (kind == Kind::DEVICE_INFO && fn5) fn5(arg1,arg2,arg3,arg4);
         }
-        void operator()(bool arg1, std::string arg2, KeyType &arg3, napiError arg4) {
-            if (fn6) fn6(arg1,arg2,arg3,arg4);
+        void operator()(bool arg1, const std::string &arg2, KeyType arg3, const napiError &arg4) {
+            if (kind == Kind::KEY && fn6) fn6(arg1,arg2,arg3,arg4);
+        }
+        void operator()(bool arg1, std::map<std::string,TransientNymiBandInfo> &arg2, const napiError &arg3) {
+            if (kind == Kind::ALL_DEVICE_INFO && fn7) fn7(arg1,arg2,arg3);
         }
 	};
 
-public:
-    static std::map<std::string, NeaCallback> nymiProvisions;
+    //callback for a request in flight, along with the pid it was made on
+    struct PendingExchange {
+        const std::string *pid = nullptr;   //interned, see internPid
+        NeaCallback callback;
+        std::chrono::steady_clock::time_point issued;
+    };
+
+    //written from application threads, read and erased from the listener thread
+    static ExchangeRegistry<PendingExchange> nymiProvisions;
+
+    //deadlines of the exchanges in nymiProvisions, advanced by the listener thread
+    static TimerWheel deadlines;
+
+    //state of every band, indexed by pid index. written by the listener from notifications, read by getBandState
+    static BandStateTable bandStates;
+    static std::uint32_t bandIndex(const NymiProvision &band) { return band.m_index; }
 };
 
+static_assert(std::is_trivially_copyable<NymiProvision>::value, "NymiProvision is meant to be a cheap value handle");
+
 #endif /* NymiProvision_h */
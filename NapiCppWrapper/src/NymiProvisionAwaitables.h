@@ -0,0 +1,175 @@
+//
+//  NymiProvisionAwaitables.h
+//  NapiCpp
+//
+//  co_await-able versions of the NymiProvision operations, for NEAs built with coroutines: C++20, or
+//  C++17 with -fcoroutines on gcc, since json.hpp 2.0.5 does not build as C++20 against libstdc++.
+//  The rest of the wrapper only requires C++11, so this header is empty otherwise.
+//
+
+#ifndef NymiProvisionAwaitables_h
+#define NymiProvisionAwaitables_h
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include <coroutine>
+#include <string>
+#include <utility>
+#include "NymiProvision.h"
+#include "CallbackExecutor.h"
+
+/*
+    Usage, inside a coroutine:
+
+        NapiResult<EcdsaSignature> res = co_await NymiAwait::signMessage(band, msghash);
+
+    The awaitable lives in the coroutine frame. The request is registered in NymiProvision::nymiProvisions
+    with a callback that only holds a pointer to the awaitable, which fits in std::function's inline storage,
+    so awaiting adds no allocation of its own. When the Listener dispatches the response, the callback stores
+    the result in the awaitable and hands the coroutine to the resumer.
+ */
+namespace NymiAwait {
+
+    //resumes the coroutine on the thread that delivers the response (NymiApi::listener, or a callback executor worker)
+    struct InlineResumer {
+        void resume(std::coroutine_handle<> handle) const { handle.resume(); }
+    };
+
+    //resumes the coroutine on a CallbackExecutor strand, e.g. the pid of the band, to keep per band ordering.
+    //strand must outlive the await; &band.getPid() does, pids are interned
+    struct ExecutorResumer {
+        CallbackExecutor *executor;
+        const std::string *strand;
+        void resume(std::coroutine_handle<> handle) const { executor->post(*strand, [handle]{ handle.resume(); }); }
+    };
+
+    template <typename T, typename Resumer, typename Start>
+    class Awaitable {
+
+    public:
+
+        Awaitable(Resumer resumer, Start start) :resumer(std::move(resumer)), start(std::move(start)) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        //once the request is issued the response may resume the coroutine, and destroy this awaitable, on
+        //another thread before await_suspend returns. start is moved to the stack so that nothing of this
+        //is used after the request is queued
+        bool await_suspend(std::coroutine_handle<> h) {
+
+            handle = h;
+            Start issue = std::move(start);
+            if (issue(this)) return true;
+
+            result = NapiResult<T>{ false, "", T(), napiError{ "ERROR. Request could not be issued.", {} } };
+            return false;
+        }
+
+        NapiResult<T> await_resume() { return std::move(result); }
+
+        void complete(bool opResult, const std::string &pid, T value, const napiError &err) {
+
+            result = NapiResult<T>{ opResult, pid, std::move(value), err };
+            resumer.resume(handle);
+        }
+
+    private:
+
+        Resumer resumer;
+        Start start;
+        std::coroutine_handle<> handle;
+        NapiResult<T> result;
+    };
+
+    template <typename T, typename Resumer, typename Start>
+    Awaitable<T, Resumer, Start> makeAwaitable(Resumer resumer, Start start) {
+        return Awaitable<T, Resumer, Start>(std::move(resumer), std::move(start));
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto getRandom(NymiProvision prov, Resumer resumer = Resumer()) {
+        return makeAwaitable<std::string>(std::move(resumer), [prov](auto *aw) mutable {
+            return prov.getRandom(randomCallback([aw](bool opResult, const std::string &pid, const std::string &rand, const napiError &err) {
+                aw->complete(opResult, pid, rand, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto getSymmetricKey(NymiProvision prov, Resumer resumer = Resumer()) {
+        return makeAwaitable<std::string>(std::move(resumer), [prov](auto *aw) mutable {
+            return prov.getSymmetricKey(symmetricKeyCallback([aw](bool opResult, const std::string &pid, const std::string &sk, const napiError &err) {
+                aw->complete(opResult, pid, sk, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto createSymmetricKey(NymiProvision prov, bool guarded, Resumer resumer = Resumer()) {
+        return makeAwaitable<KeyType>(std::move(resumer), [prov, guarded](auto *aw) mutable {
+            return prov.createSymmetricKey(guarded, createdKeyCallback([aw](bool opResult, const std::string &pid, KeyType keyType, const napiError &err) {
+                aw->complete(opResult, pid, keyType, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto signMessage(NymiProvision prov, std::string msghash, Resumer resumer = Resumer()) {
+        return makeAwaitable<EcdsaSignature>(std::move(resumer), [prov, msghash](auto *aw) mutable {
+            return prov.signMessage(msghash, ecdsaSignCallback([aw](bool opResult, const std::string &pid, const std::string &sig, const std::string &vk, const napiError &err) {
+                aw->complete(opResult, pid, EcdsaSignature{ sig, vk }, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto createTotpKey(NymiProvision prov, std::string totpKey, bool guarded, Resumer resumer = Resumer()) {
+        return makeAwaitable<KeyType>(std::move(resumer), [prov, totpKey, guarded](auto *aw) mutable {
+            return prov.createTotpKey(totpKey, guarded, createdKeyCallback([aw](bool opResult, const std::string &pid, KeyType keyType, const napiError &err) {
+                aw->complete(opResult, pid, keyType, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto getTotpKey(NymiProvision prov, Resumer resumer = Resumer()) {
+        return makeAwaitable<std::string>(std::move(resumer), [prov](auto *aw) mutable {
+            return prov.getTotpKey(totpGetCallback([aw](bool opResult, const std::string &pid, const std::string &totp, const napiError &err) {
+                aw->complete(opResult, pid, totp, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto getDeviceInfo(NymiProvision prov, Resumer resumer = Resumer()) {
+        return makeAwaitable<TransientNymiBandInfo>(std::move(resumer), [prov](auto *aw) mutable {
+            return prov.getDeviceInfo(deviceInfoCallback([aw](bool opResult, const std::string &pid, TransientNymiBandInfo &info, const napiError &err) {
+                aw->complete(opResult, pid, info, err);
+            }));
+        });
+    }
+
+    template <typename Resumer = InlineResumer>
+    auto revokeKey(NymiProvision prov, KeyType keyType, Resumer resumer = Resumer()) {
+        return makeAwaitable<KeyType>(std::move(resumer), [prov, keyType](auto *aw) mutable {
+            return prov.revokeKey(keyType, revokedKeyCallback([aw](bool opResult, const std::string &pid, KeyType revoked, const napiError &err) {
+                aw->complete(opResult, pid, revoked, err);
+            }));
+        });
+    }
+
+    //value is opResult
+    template <typename Resumer = InlineResumer>
+    auto revokeProvision(NymiProvision prov, bool onlyIfAuthenticated, Resumer resumer = Resumer()) {
+        return makeAwaitable<bool>(std::move(resumer), [prov, onlyIfAuthenticated](auto *aw) mutable {
+            return prov.revokeProvision(onlyIfAuthenticated, onProvisionRevokedCallback([aw](bool opResult, const std::string &pid, const napiError &err) {
+                aw->complete(opResult, pid, opResult, err);
+            }));
+        });
+    }
+
+} //end namespace NymiAwait
+
+#endif /* __cpp_impl_coroutine */
+
+#endif /* NymiProvisionAwaitables_h */
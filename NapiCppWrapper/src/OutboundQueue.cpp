@@ -0,0 +1,154 @@
+//
+//  OutboundQueue.cpp
+//  NapiCpp
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "OutboundQueue.h"
+#include "Tracing.h"
+#include "Recording.h"
+#include "json-napi.h"
+
+namespace PrivateOutbound {
+
+    using steadyClock = std::chrono::steady_clock;
+
+    struct Node {
+        std::string json;
+        const std::string *band;
+        std::uint64_t traceId;
+        steadyClock::time_point enqueued;
+        Node *next;
+    };
+
+    //most puts written per pass of the round robin, before new arrivals are picked up
+    const std::size_t maxBatch = 64;
+
+    //producers push onto this stack with a CAS, the writer takes the whole stack with one exchange
+    std::atomic<Node*> head{ nullptr };
+
+    std::atomic<bool> quit{ false };
+    std::mutex wakeMtx;
+    std::condition_variable wakeCv;
+
+    std::atomic<std::size_t> queueDepth{ 0 };
+    std::atomic<std::uint64_t> putCount{ 0 };
+    std::atomic<std::uint64_t> batchCount{ 0 };
+    std::atomic<std::uint64_t> totalLatencyUs{ 0 };
+    std::atomic<std::uint64_t> maxLatencyUs{ 0 };
+
+    void setQuit(bool _quit) {
+
+        {
+            std::lock_guard<std::mutex> lock(wakeMtx);
+            quit.store(_quit);
+        }
+        wakeCv.notify_one();
+    }
+
+    void put(std::string json, const std::string *band, std::uint64_t traceId) {
+
+        Node *node = new Node{ std::move(json), band, traceId, steadyClock::now(), nullptr };
+        queueDepth.fetch_add(1, std::memory_order_relaxed);
+
+        Node *prev = head.load(std::memory_order_relaxed);
+        do {
+            node->next = prev;
+        } while (!head.compare_exchange_weak(prev, node, std::memory_order_release, std::memory_order_relaxed));
+
+        //only the transition from empty needs to wake the writer. taking the mutex here
+        //guarantees the writer is either before its predicate check or already waiting.
+        if (prev == nullptr) {
+            { std::lock_guard<std::mutex> lock(wakeMtx); }
+            wakeCv.notify_one();
+        }
+    }
+
+    void write(Node *node) {
+
+        steadyClock::time_point putStart = steadyClock::now();
+        if (PrivateRecord::enabled()) PrivateRecord::record(PrivateRecord::Direction::OUTBOUND, node->json, putStart);
+        nymi::jsonNapiPut(node->json);
+        steadyClock::time_point putEnd = steadyClock::now();
+
+        if (node->traceId != 0 && PrivateTrace::enabled()) {
+            PrivateTrace::step(node->traceId, "put", putStart);
+            PrivateTrace::span("jsonNapiPut", node->traceId, putStart, putEnd);
+        }
+
+        std::uint64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(putEnd - node->enqueued).count();
+        totalLatencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+        if (latencyUs > maxLatencyUs.load(std::memory_order_relaxed)) {
+            maxLatencyUs.store(latencyUs, std::memory_order_relaxed);   //single writer, no CAS needed
+        }
+        putCount.fetch_add(1, std::memory_order_relaxed);
+        queueDepth.fetch_sub(1, std::memory_order_relaxed);
+
+        delete node;
+    }
+
+    void writeMessages() {
+
+        //per band FIFOs, and the bands that currently have something queued, in round robin order
+        std::unordered_map<const std::string*, std::deque<Node*> > perBand;
+        std::deque<const std::string*> activeBands;
+
+        while (true) {
+
+            if (activeBands.empty()) {
+                std::unique_lock<std::mutex> lock(wakeMtx);
+                wakeCv.wait(lock, []{ return head.load() != nullptr || quit.load(); });
+            }
+
+            //take everything queued so far, the stack is newest first
+            Node *taken = head.exchange(nullptr, std::memory_order_acquire);
+            std::vector<Node*> arrivals;
+            for (; taken != nullptr; taken = taken->next) { arrivals.push_back(taken); }
+
+            for (auto it = arrivals.rbegin(); it != arrivals.rend(); ++it) {
+                auto &fifo = perBand[(*it)->band];
+                if (fifo.empty()) { activeBands.push_back((*it)->band); }
+                fifo.push_back(*it);
+            }
+
+            if (activeBands.empty()) {
+                if (quit.load()) break;
+                continue;
+            }
+
+            batchCount.fetch_add(1, std::memory_order_relaxed);
+
+            //one request per band per turn
+            for (std::size_t written = 0; written < maxBatch && !activeBands.empty(); ++written) {
+
+                const std::string *band = activeBands.front();
+                activeBands.pop_front();
+
+                auto &fifo = perBand[band];
+                Node *node = fifo.front();
+                fifo.pop_front();
+                if (!fifo.empty()) { activeBands.push_back(band); }
+
+                write(node);
+            }
+        }
+    }
+
+    OutboundStats getStats() {
+
+        OutboundStats stats;
+        stats.queueDepth = queueDepth.load(std::memory_order_relaxed);
+        stats.putCount = putCount.load(std::memory_order_relaxed);
+        stats.batchCount = batchCount.load(std::memory_order_relaxed);
+        stats.meanLatencyUs = stats.putCount ? (double)totalLatencyUs.load(std::memory_order_relaxed) / stats.putCount : 0.0;
+        stats.maxLatencyUs = maxLatencyUs.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+} //end namespace PrivateOutbound
@@ -0,0 +1,42 @@
+//
+//  OutboundQueue.h
+//  NapiCpp
+//
+//  Requests to napi are queued here by the application threads and handed to
+//  nymi::jsonNapiPut by a single writer thread, NymiApi::writer.
+//
+
+#ifndef OutboundQueue_h
+#define OutboundQueue_h
+
+#include <cstdint>
+#include <string>
+
+namespace PrivateOutbound {
+
+    struct OutboundStats {
+        std::size_t queueDepth;         //requests enqueued and not yet passed to jsonNapiPut
+        std::uint64_t putCount;         //requests passed to jsonNapiPut
+        std::uint64_t batchCount;       //number of times the writer woke up and drained the queue
+        double meanLatencyUs;           //mean time from put() to jsonNapiPut
+        std::uint64_t maxLatencyUs;
+    };
+
+    //lock-free, callable from any thread.
+    //requests with the same band are written in the order they were queued; requests for
+    //different bands are interleaved so that a burst on one band does not delay the others.
+    //pass the interned pid of the band (NymiProvision::m_pid), or nullptr for requests not tied to a band.
+    //traceId is the ExchangeId::seq of the request, 0 if it has none, see PrivateTrace.
+    void put(std::string json, const std::string *band = nullptr, std::uint64_t traceId = 0);
+
+    //loop variable in writeMessages. on quit, the writer drains what is queued before returning
+    void setQuit(bool _quit);
+
+    //running on the thread NymiApi::writer
+    void writeMessages();
+
+    OutboundStats getStats();
+
+} //end namespace PrivateOutbound
+
+#endif /* OutboundQueue_h */
@@ -0,0 +1,107 @@
+//
+//  Recording.cpp
+//  NapiCpp
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include "Recording.h"
+#include "Listener.h"
+
+namespace PrivateRecord {
+
+    const char magic[8] = { 'N', 'A', 'P', 'I', 'R', 'E', 'C', '1' };
+    const std::size_t frameHeaderLength = 1 + 8 + 4;
+
+    std::atomic<bool> recording{ false };
+
+    std::mutex fileMtx;
+    std::ofstream file;
+    std::chrono::steady_clock::time_point epoch;
+
+    void writeLittleEndian(char *out, std::uint64_t val, int bytes) {
+        for (int i = 0; i < bytes; ++i) {
+            out[i] = static_cast<char>((val >> (8 * i)) & 0xff);
+        }
+    }
+
+    std::uint64_t readLittleEndian(const char *in, int bytes) {
+        std::uint64_t val = 0;
+        for (int i = bytes - 1; i >= 0; --i) {
+            val = (val << 8) | static_cast<unsigned char>(in[i]);
+        }
+        return val;
+    }
+
+    bool start(const std::string &path) {
+
+        std::lock_guard<std::mutex> lock(fileMtx);
+
+        if (file.is_open()) file.close();
+        file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+
+        file.write(magic, sizeof(magic));
+        epoch = std::chrono::steady_clock::now();
+        recording.store(true);
+        return true;
+    }
+
+    void stop() {
+
+        std::lock_guard<std::mutex> lock(fileMtx);
+        recording.store(false);
+        if (file.is_open()) file.close();
+    }
+
+    void record(Direction direction, const std::string &json, std::chrono::steady_clock::time_point at) {
+
+        char header[frameHeaderLength];
+        header[0] = static_cast<char>(direction);
+        writeLittleEndian(&header[9], json.size(), 4);
+
+        std::lock_guard<std::mutex> lock(fileMtx);
+        if (!recording.load(std::memory_order_relaxed)) return;     //stopped since the caller checked
+
+        //a message that went by just before start is stamped at the start of the recording
+        std::uint64_t us = at > epoch ? std::chrono::duration_cast<std::chrono::microseconds>(at - epoch).count() : 0;
+        writeLittleEndian(&header[1], us, 8);
+
+        file.write(header, sizeof(header));
+        file.write(json.data(), json.size());
+    }
+
+    bool replay(const std::string &path, double speed, std::uint64_t &replayed) {
+
+        replayed = 0;
+
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        char fileMagic[sizeof(magic)];
+        if (!in.read(fileMagic, sizeof(fileMagic)) || std::memcmp(fileMagic, magic, sizeof(magic)) != 0) return false;
+
+        auto replayStart = std::chrono::steady_clock::now();
+        char header[frameHeaderLength];
+        std::string json;
+
+        while (in.read(header, sizeof(header))) {
+
+            std::uint64_t us = readLittleEndian(&header[1], 8);
+            json.resize(static_cast<std::size_t>(readLittleEndian(&header[9], 4)));
+            if (!json.empty() && !in.read(&json[0], json.size())) break;      //last frame cut short
+
+            if (header[0] != static_cast<char>(Direction::INBOUND)) continue;
+
+            if (speed > 0) {
+                std::this_thread::sleep_until(replayStart + std::chrono::microseconds(static_cast<std::uint64_t>(us / speed)));
+            }
+
+            PrivateListener::dispatchMessage(json, std::chrono::steady_clock::now());
+            ++replayed;
+        }
+        return true;
+    }
+
+} //end namespace PrivateRecord
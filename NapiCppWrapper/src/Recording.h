@@ -0,0 +1,51 @@
+//
+//  Recording.h
+//  NapiCpp
+//
+//  Capture of the json exchanged with napi, and replay of the captured napi messages
+//  into PrivateListener. See NymiApi::startRecording and NymiApi::replayRecording.
+//
+
+#ifndef Recording_h
+#define Recording_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/*
+    A recording is the 8 byte magic "NAPIREC1" followed by one frame per message:
+        direction   1 byte, 'O' for a jsonNapiPut, 'I' for a jsonNapiGet
+        time        8 bytes, little endian, us since the recording started: for 'O' just before jsonNapiPut,
+                    for 'I' when jsonNapiGet returned the message. frames are written in the order they are
+                    recorded, so an 'O' and an 'I' recorded at about the same time can be out of time order
+        length      4 bytes, little endian
+        json        length bytes, as passed to or received from napi
+    Frames are appended as messages go by, so a recording cut short by a crash is readable up to its last whole frame.
+ */
+namespace PrivateRecord {
+
+    enum class Direction : char { OUTBOUND = 'O', INBOUND = 'I' };
+
+    extern std::atomic<bool> recording;
+
+    //every call site checks this first, so not recording costs one relaxed load
+    inline bool enabled() { return recording.load(std::memory_order_relaxed); }
+
+    //truncates path. false if it cannot be opened
+    bool start(const std::string &path);
+    void stop();
+
+    //called on NymiApi::writer and NymiApi::listener. at is when the message went by, see the frame layout above
+    void record(Direction direction, const std::string &json, std::chrono::steady_clock::time_point at);
+
+    //feeds the inbound messages of a recording to PrivateListener::dispatchMessage on the calling thread, which is
+    //the listener thread, or any thread while no listener is running, see NymiApi::replayRecording.
+    //speed scales the recorded gaps between them, e.g. 1 for the original pace, 10 for ten times faster, 0 for no gaps.
+    //outbound frames are skipped. false if the file is not a recording; replayed counts the messages dispatched
+    bool replay(const std::string &path, double speed, std::uint64_t &replayed);
+
+} //end namespace PrivateRecord
+
+#endif /* Recording_h */
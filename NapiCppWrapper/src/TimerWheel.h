@@ -0,0 +1,220 @@
+//
+//  TimerWheel.h
+//  NapiCpp
+//
+//  Deadlines of the requests pending in NymiProvision::nymiProvisions.
+//  Scheduled when a request is registered, cancelled when its response is taken,
+//  and advanced by the listener thread, which fails the requests that expire.
+//
+
+#ifndef TimerWheel_h
+#define TimerWheel_h
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "ExchangeId.h"
+
+/*
+    Hierarchical timing wheel with 4 levels of 64 buckets. A level 0 bucket spans one tick (10ms),
+    a level 1 bucket 64 ticks, and so on, so the wheel covers about 46 hours; longer timeouts are
+    clamped to that. When the level 0 wheel wraps, the next level 1 bucket is redistributed into
+    level 0, and likewise up the levels.
+
+    A pending exchange owns its registry slot until it is taken, and ExchangeId::slot is unique
+    among pending exchanges, so timers are stored in a vector indexed by slot. Buckets are intrusive
+    doubly linked lists through that vector: schedule and cancel are O(1) and allocate nothing once
+    the vector has grown to the number of exchanges in flight.
+ */
+class TimerWheel {
+
+public:
+
+    using steadyClock = std::chrono::steady_clock;
+
+    static const int tickMs = 10;
+    static const int levelBits = 6;
+    static const int bucketsPerLevel = 1 << levelBits;
+    static const int numLevels = 4;
+    static const std::uint64_t maxTicks = (1ull << (levelBits * numLevels)) - 1;
+
+    TimerWheel() :epoch(steadyClock::now()) {
+        for (auto &head : buckets) head = none;
+    }
+
+    void schedule(const ExchangeId &id, std::uint32_t timeoutMs) {
+
+        std::uint64_t ticks = (timeoutMs + tickMs - 1) / tickMs;
+        if (ticks == 0) ticks = 1;
+        if (ticks > maxTicks) ticks = maxTicks;
+
+        std::lock_guard<std::mutex> lock(mtx);
+
+        //expiry is relative to now, the wheel may be behind if the listener has not advanced it recently
+        std::uint64_t expiry = std::max(toTick(steadyClock::now()), currentTick) + ticks;
+
+        if (id.slot >= timers.size()) timers.resize(id.slot + 1);
+        Timer &timer = timers[id.slot];
+
+        //the slot's previous exchange was taken but its timer not yet cancelled
+        if (timer.bucket != none) unlink(id.slot);
+
+        timer.seq = id.seq;
+        timer.op = id.op;
+        timer.expiry = expiry;
+        link(id.slot);
+        ++pending;
+    }
+
+    //returns false if the timer already expired, or was never scheduled
+    bool cancel(const ExchangeId &id) {
+
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (id.slot >= timers.size()) return false;
+        Timer &timer = timers[id.slot];
+        if (timer.bucket == none || timer.seq != id.seq) return false;
+
+        unlink(id.slot);
+        return true;
+    }
+
+    //moves the wheel up to now, and appends the exchanges whose deadline has passed to expired
+    void advance(steadyClock::time_point now, std::vector<ExchangeId> &expired) {
+
+        std::uint64_t nowTick = toTick(now);
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (pending == 0) {
+            if (nowTick > currentTick) currentTick = nowTick;
+            return;
+        }
+
+        while (currentTick < nowTick) {
+
+            ++currentTick;
+
+            //redistribute the higher levels whose bucket boundary was just crossed, top down
+            int level = 0;
+            while (level + 1 < numLevels && (currentTick & ((1ull << (levelBits * (level + 1))) - 1)) == 0) ++level;
+            for (; level > 0; --level) {
+
+                std::int32_t &head = buckets[level * bucketsPerLevel + ((currentTick >> (levelBits * level)) & (bucketsPerLevel - 1))];
+                std::int32_t idx = head;
+                head = none;
+                while (idx != none) {
+                    std::int32_t next = timers[idx].next;
+                    link(idx);
+                    idx = next;
+                }
+            }
+
+            std::int32_t &head = buckets[currentTick & (bucketsPerLevel - 1)];
+            while (head != none) {
+
+                std::int32_t idx = head;
+                Timer &timer = timers[idx];
+                ExchangeId id;
+                id.seq = timer.seq;
+                id.op = timer.op;
+                id.slot = static_cast<std::uint32_t>(idx);
+                unlink(idx);
+                expired.push_back(id);
+            }
+
+            if (pending == 0) {
+                currentTick = nowTick;
+                break;
+            }
+        }
+    }
+
+    //earliest time at which advance has work to do: the expiry of the next timer on level 0, or the
+    //redistribution of the next non-empty bucket of a higher level, whichever is first. time_point::max()
+    //when nothing is scheduled
+    steadyClock::time_point nextDeadline() {
+
+        std::lock_guard<std::mutex> lock(mtx);
+
+        if (pending == 0) return steadyClock::time_point::max();
+
+        std::uint64_t next = currentTick + maxTicks + 1;
+        for (int level = 0; level < numLevels; ++level) {
+
+            int shift = levelBits * level;
+            for (std::uint64_t k = 1; k <= bucketsPerLevel; ++k) {
+
+                std::uint64_t tick = ((currentTick >> shift) + k) << shift;
+                if (tick >= next) break;
+                if (buckets[level * bucketsPerLevel + ((tick >> shift) & (bucketsPerLevel - 1))] != none) {
+                    next = tick;
+                    break;
+                }
+            }
+        }
+        return epoch + std::chrono::milliseconds(next * tickMs);
+    }
+
+    std::size_t size() {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        return pending;
+    }
+
+private:
+
+    static const std::int32_t none = -1;
+
+    struct Timer {
+        std::uint64_t seq = 0;
+        ExchangeOp op = ExchangeOp::ERROR;
+        std::uint64_t expiry = 0;
+        std::int32_t prev = none;
+        std::int32_t next = none;
+        std::int32_t bucket = none;     //none when not scheduled
+    };
+
+    std::uint64_t toTick(steadyClock::time_point t) const {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(t - epoch).count()) / tickMs;
+    }
+
+    //puts the timer in the bucket for its expiry, on the lowest level that reaches it
+    void link(std::int32_t idx) {
+
+        Timer &timer = timers[idx];
+        std::uint64_t delta = timer.expiry > currentTick ? timer.expiry - currentTick : 0;
+
+        int level = 0;
+        while (level + 1 < numLevels && delta >= (1ull << (levelBits * (level + 1)))) ++level;
+
+        std::int32_t bucket = level * bucketsPerLevel + static_cast<std::int32_t>((timer.expiry >> (levelBits * level)) & (bucketsPerLevel - 1));
+        timer.bucket = bucket;
+        timer.prev = none;
+        timer.next = buckets[bucket];
+        if (timer.next != none) timers[timer.next].prev = idx;
+        buckets[bucket] = idx;
+    }
+
+    void unlink(std::int32_t idx) {
+
+        Timer &timer = timers[idx];
+        if (timer.prev != none) timers[timer.prev].next = timer.next;
+        else buckets[timer.bucket] = timer.next;
+        if (timer.next != none) timers[timer.next].prev = timer.prev;
+
+        timer.bucket = timer.prev = timer.next = none;
+        --pending;
+    }
+
+    const steadyClock::time_point epoch;
+
+    std::mutex mtx;
+    std::uint64_t currentTick = 0;
+    std::size_t pending = 0;
+    std::vector<Timer> timers;
+    std::int32_t buckets[numLevels * bucketsPerLevel];
+};
+
+#endif /* TimerWheel_h */
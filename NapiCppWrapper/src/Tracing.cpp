@@ -0,0 +1,146 @@
+//
+//  Tracing.cpp
+//  NapiCpp
+//
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include "Tracing.h"
+
+namespace PrivateTrace {
+
+    struct Event {
+        char phase;             //b, n, e (async) or X (complete)
+        const char *name;       //string literals only
+        const char *arg;        //stage or outcome, may be null
+        std::uint64_t id;
+        std::int64_t tsUs;
+        std::int64_t durUs;
+        std::uint32_t tid;
+    };
+
+    std::atomic<bool> tracing{ false };
+
+    std::mutex mtx;
+    std::vector<Event> events;
+    std::size_t capacity = 0;
+    std::uint64_t dropped = 0;
+    std::chrono::steady_clock::time_point epoch;
+
+    std::atomic<std::uint32_t> nextTid{ 1 };
+
+    //small ids, std::thread::id has no portable numeric form
+    std::uint32_t threadId() {
+        thread_local std::uint32_t tid = nextTid.fetch_add(1, std::memory_order_relaxed);
+        return tid;
+    }
+
+    const char *opName(ExchangeOp op) {
+
+        switch (op) {
+            case ExchangeOp::RANDOM: return "getRandom";
+            case ExchangeOp::CREATE_SYMMETRIC_KEY: return "createSymmetricKey";
+            case ExchangeOp::GET_SYMMETRIC_KEY: return "getSymmetricKey";
+            case ExchangeOp::SIGN: return "signMessage";
+            case ExchangeOp::CREATE_TOTP: return "createTotp";
+            case ExchangeOp::GET_TOTP: return "getTotp";
+            case ExchangeOp::NOTIFY: return "sendNotification";
+            case ExchangeOp::DEVICE_INFO: return "getDeviceInfo";
+            case ExchangeOp::REVOKE_KEY: return "revokeKey";
+            case ExchangeOp::REVOKE_PROVISION: return "revokeProvision";
+            default: return "exchange";
+        }
+    }
+
+    void record(char phase, const char *name, const char *arg, std::uint64_t id,
+                std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+
+        Event event;
+        event.phase = phase;
+        event.name = name;
+        event.arg = arg;
+        event.id = id;
+        event.durUs = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+        event.tid = threadId();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!tracing.load(std::memory_order_relaxed)) return;     //stopped since the caller checked
+        if (events.size() >= capacity) {
+            ++dropped;
+            return;
+        }
+        event.tsUs = std::chrono::duration_cast<std::chrono::microseconds>(from - epoch).count();
+        events.push_back(event);
+    }
+
+    void start(std::size_t maxEvents) {
+
+        std::lock_guard<std::mutex> lock(mtx);
+        events.clear();
+        events.reserve(maxEvents);
+        capacity = maxEvents;
+        dropped = 0;
+        epoch = std::chrono::steady_clock::now();
+        tracing.store(true);
+    }
+
+    void begin(std::uint64_t id, ExchangeOp op) {
+        auto now = std::chrono::steady_clock::now();
+        record('b', opName(op), nullptr, id, now, now);
+    }
+
+    void step(std::uint64_t id, const char *stage, std::chrono::steady_clock::time_point when) {
+        record('n', stage, stage, id, when, when);
+    }
+
+    void end(std::uint64_t id, ExchangeOp op, const char *outcome) {
+        auto now = std::chrono::steady_clock::now();
+        record('e', opName(op), outcome, id, now, now);
+    }
+
+    void span(const char *name, std::uint64_t id, std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        record('X', name, nullptr, id, from, to);
+    }
+
+    bool stop(const std::string &path) {
+
+        std::vector<Event> recorded;
+        std::uint64_t droppedEvents;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            tracing.store(false);
+            recorded.swap(events);
+            droppedEvents = dropped;
+        }
+
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file) return false;
+
+        char idHex[19];
+        file << "{\"traceEvents\":[";
+        for (std::size_t i = 0; i < recorded.size(); ++i) {
+
+            const Event &event = recorded[i];
+            std::snprintf(idHex, sizeof(idHex), "0x%llx", static_cast<unsigned long long>(event.id));
+
+            if (i > 0) file << ",";
+            file << "\n{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase << "\",\"ts\":" << event.tsUs
+                 << ",\"pid\":1,\"tid\":" << event.tid;
+
+            if (event.phase == 'X') {
+                file << ",\"dur\":" << event.durUs << ",\"cat\":\"napi\",\"args\":{\"exchange\":\"" << idHex << "\"}}";
+            }
+            else {
+                file << ",\"cat\":\"exchange\",\"id\":\"" << idHex << "\"";
+                if (event.arg) file << ",\"args\":{\"stage\":\"" << event.arg << "\"}";
+                file << "}";
+            }
+        }
+        file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << droppedEvents << "}}\n";
+
+        return static_cast<bool>(file);
+    }
+
+} //end namespace PrivateTrace
@@ -0,0 +1,42 @@
+//
+//  Tracing.h
+//  NapiCpp
+//
+//  Per exchange spans, from a request being queued to its callback returning, written out
+//  in the Chrome trace event format (chrome://tracing, Perfetto). See NymiApi::startTracing.
+//
+
+#ifndef Tracing_h
+#define Tracing_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "ExchangeId.h"
+
+namespace PrivateTrace {
+
+    extern std::atomic<bool> tracing;
+
+    //every call site checks this first, so a disabled trace costs one relaxed load
+    inline bool enabled() { return tracing.load(std::memory_order_relaxed); }
+
+    //clears what was recorded and starts recording. events past maxEvents are dropped and counted
+    void start(std::size_t maxEvents);
+
+    //stops recording and writes {"traceEvents":[...]} to path
+    bool stop(const std::string &path);
+
+    //id is ExchangeId::seq. an exchange is one async slice from begin to end,
+    //with a step event at each stage in between, e.g. "put", "received", "handler"
+    void begin(std::uint64_t id, ExchangeOp op);
+    void step(std::uint64_t id, const char *stage, std::chrono::steady_clock::time_point when);
+    void end(std::uint64_t id, ExchangeOp op, const char *outcome);
+
+    //a complete event on the calling thread, e.g. the time spent in jsonNapiPut
+    void span(const char *name, std::uint64_t id, std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to);
+
+} //end namespace PrivateTrace
+
+#endif /* Tracing_h */
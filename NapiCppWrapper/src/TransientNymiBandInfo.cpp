@@ -6,169 +6,230 @@
 //  Copyright © 2016 Hanieh Bastani. All rights reserved.
 //
 
+#include <cstring>
 #include "TransientNymiBandInfo.h"
-#include "JsonUtilityFunctions.h"
 
-TransientNymiBandInfo::TransientNymiBandInfo(nljson &jobj):deviceInfo(jobj){}
+TransientNymiBandInfo::TransientNymiBandInfo()
+    :sinceLastContact(0), authenticationWindowRemaining(0), rssiLast(0), rssiSmoothed(0), numCommandsQueued(0),
+     has(0), flags(0), found(FoundStatus::ERROR), presence(PresenceStatus::ERROR), firmwareVersionLength(0), pidLength(0) {}
 
-bool TransientNymiBandInfo::getRssiLast(int &val){
+TransientNymiBandInfo::TransientNymiBandInfo(const nljson &jobj) :TransientNymiBandInfo() {
     
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"RSSI_last"},jit)){
-        val = jit.value();
-        return true;
+    const nljson::object_t *info = jobj.get_ptr<const nljson::object_t*>();
+    if (info == nullptr) return;
+    
+    std::shared_ptr<Overflow> more;
+    const std::string *longPid = nullptr;
+    
+    for (auto &field : *info) {
+        
+        const std::string &key = field.first;
+        const nljson &val = field.second;
+        
+        if (key == "RSSI_last") {
+            if (val.is_number()) { rssiLast = val; has |= RSSI_LAST; }
+        }
+        else if (key == "RSSI_smoothed") {
+            if (val.is_number()) { rssiSmoothed = val; has |= RSSI_SMOOTHED; }
+        }
+        else if (key == "commandQueue") {
+            if (!val.is_array()) continue;
+            has |= COMMAND_QUEUE;
+            for (auto &cmd : val) {
+                if (!cmd.is_string()) continue;
+                if (!more) more = std::make_shared<Overflow>();
+                more->commandQueue.push_back(cmd.get_ref<const std::string&>());
+            }
+        }
+        else if (key == "firmwareVersion") {
+            if (!val.is_string()) continue;
+            const std::string &version = val.get_ref<const std::string&>();
+            has |= FIRMWARE_VERSION;
+            if (version.size() <= sizeof(firmwareVersion)) {
+                firmwareVersionLength = static_cast<std::uint8_t>(version.size());
+                std::memcpy(firmwareVersion, version.data(), version.size());
+            }
+            else {
+                if (!more) more = std::make_shared<Overflow>();
+                more->firmwareVersion = version;
+                has |= LONG_FIRMWARE_VERSION;
+            }
+        }
+        else if (key == "found") {
+            if (!val.is_string()) continue;
+            auto it = foundEnum.find(val.get_ref<const std::string&>());
+            if (it != foundEnum.end()) { found = it->second; has |= FOUND; }
+        }
+        else if (key == "present") {
+            if (!val.is_string()) continue;
+            auto it = presentEnum.find(val.get_ref<const std::string&>());
+            if (it != presentEnum.end()) { presence = it->second; has |= PRESENT; }
+        }
+        else if (key == "isProvisioned") {
+            if (val.is_boolean()) { has |= IS_PROVISIONED; if (val.get<bool>()) flags |= IS_PROVISIONED; }
+        }
+        else if (key == "sinceLastContact") {
+            if (val.is_number()) { sinceLastContact = val; has |= SINCE_LAST_CONTACT; }
+        }
+        else if (key == "provisioned") {
+            const nljson::object_t *provisioned = val.get_ptr<const nljson::object_t*>();
+            if (provisioned != nullptr) decodeProvisioned(*provisioned, longPid);
+        }
     }
-    return false;
+    
+    if (longPid != nullptr) {
+        if (!more) more = std::make_shared<Overflow>();
+        more->pid = *longPid;
+    }
+    overflow = std::move(more);
 }
 
-bool TransientNymiBandInfo::getRssiSmoothed(int &val){
-
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"RSSI_smoothed"},jit)){
-        val = jit.value();
-        return true;
+void TransientNymiBandInfo::decodeProvisioned(const nljson::object_t &provisioned, const std::string *&longPid){
+    
+    for (auto &field : provisioned) {
+        
+        const std::string &key = field.first;
+        const nljson &val = field.second;
+        
+        if (key == "authenticationWindowRemaining") {
+            if (val.is_number()) { authenticationWindowRemaining = val; has |= AUTHENTICATION_WINDOW_REMAINING; }
+        }
+        else if (key == "commandsQueued") {
+            if (val.is_number()) { numCommandsQueued = val; has |= COMMANDS_QUEUED; }
+        }
+        else if (key == "pid") {
+            if (!val.is_string()) continue;
+            const std::string &bandPid = val.get_ref<const std::string&>();
+            has |= PID;
+            if (bandPid.size() <= sizeof(pid)) {
+                pidLength = static_cast<std::uint8_t>(bandPid.size());
+                std::memcpy(pid, bandPid.data(), bandPid.size());
+            }
+            else {
+                longPid = &bandPid;
+                has |= LONG_PID;
+            }
+        }
+        else {
+            Field flag = key == "enabledRoamingAuthSetup" ? ENABLED_ROAMING_AUTH_SETUP :
+                         key == "enabledSigning" ? ENABLED_SIGNING :
+                         key == "enabledSymmetricKeys" ? ENABLED_SYMMETRIC_KEYS :
+                         key == "enabledTOTP" ? ENABLED_TOTP : Field(0);
+            if (flag != 0 && val.is_boolean()) { has |= flag; if (val.get<bool>()) flags |= flag; }
+        }
     }
-    return false;
 }
 
-bool TransientNymiBandInfo::getCommandsQueued(std::vector<std::string> &commands){
+bool TransientNymiBandInfo::getFlag(Field field, bool &val) const {
+    
+    if (!(has & field)) return false;
+    val = (flags & field) != 0;
+    return true;
+}
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"commandQueue"},jit)){
-        for (auto cmd : jit.value()){
-            commands.push_back(cmd);
-        }
-        return true;
-    }
-    return false;
+bool TransientNymiBandInfo::getRssiLast(int &val) const {
+    
+    if (!(has & RSSI_LAST)) return false;
+    val = rssiLast;
+    return true;
+}
+
+bool TransientNymiBandInfo::getRssiSmoothed(int &val) const {
+
+    if (!(has & RSSI_SMOOTHED)) return false;
+    val = rssiSmoothed;
+    return true;
+}
+
+bool TransientNymiBandInfo::getCommandsQueued(std::vector<std::string> &commands) const {
+
+    if (!(has & COMMAND_QUEUE)) return false;
+    if (overflow) commands.insert(commands.end(), overflow->commandQueue.begin(), overflow->commandQueue.end());
+    return true;
 }
 
-bool TransientNymiBandInfo::getFirmwareVersion(std::string &val){
+bool TransientNymiBandInfo::getFirmwareVersion(std::string &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"firmwareVersion"},jit)){
-        val = jit.value();
+    if (has & LONG_FIRMWARE_VERSION) {
+        val = overflow->firmwareVersion;
+        return true;
+    }
+    if (has & FIRMWARE_VERSION) {
+        val.assign(firmwareVersion, firmwareVersionLength);
         return true;
     }
     val = "";
     return false;
 }
 
-bool TransientNymiBandInfo::getFoundState(FoundStatus &val){
+bool TransientNymiBandInfo::getFoundState(FoundStatus &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"found"},jit)){
-        std::string found = jit.value();
-        if (foundEnum.find(found) != foundEnum.end()){
-            val = foundEnum.find(found)->second;
-            return true;
-        }
-    }
-    val = FoundStatus::ERROR;
-    return false;
+    val = found;
+    return (has & FOUND) != 0;
 }
 
-bool TransientNymiBandInfo::getPresenceState(PresenceStatus &val){
+bool TransientNymiBandInfo::getPresenceState(PresenceStatus &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"present"},jit)){
-        std::string present = jit.value();
-        if (presentEnum.find(present) != presentEnum.end()){
-            val = presentEnum.find(present)->second;
-            return true;
-        }
-    }
-    val = PresenceStatus::ERROR;
-    return false;
+    val = presence;
+    return (has & PRESENT) != 0;
 }
 
-bool TransientNymiBandInfo::isProvisioned(bool &val){
+bool TransientNymiBandInfo::isProvisioned(bool &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"isProvisioned"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    return getFlag(IS_PROVISIONED, val);
 }
 
-bool TransientNymiBandInfo::getSinceLastContact(double &val){
+bool TransientNymiBandInfo::getSinceLastContact(double &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"sinceLastContact"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    if (!(has & SINCE_LAST_CONTACT)) return false;
+    val = sinceLastContact;
+    return true;
 }
 
-bool TransientNymiBandInfo::getAuthenticationWindowRemaining(double &val){
+bool TransientNymiBandInfo::getAuthenticationWindowRemaining(double &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","authenticationWindowRemaining"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    if (!(has & AUTHENTICATION_WINDOW_REMAINING)) return false;
+    val = authenticationWindowRemaining;
+    return true;
 }
 
-bool TransientNymiBandInfo::getNumCommandsQueued(int &val){
+bool TransientNymiBandInfo::getNumCommandsQueued(int &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","commandsQueued"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    if (!(has & COMMANDS_QUEUED)) return false;
+    val = numCommandsQueued;
+    return true;
 }
 
-bool TransientNymiBandInfo::enabledRoamingAuthentication(bool &val){
+bool TransientNymiBandInfo::enabledRoamingAuthentication(bool &val) const {
     
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","enabledRoamingAuthSetup"},jit)){
-        val =  jit.value();
-        return true;
-    }
-    return false;
+    return getFlag(ENABLED_ROAMING_AUTH_SETUP, val);
 }
 
-bool TransientNymiBandInfo::enabledSigning(bool &val){
+bool TransientNymiBandInfo::enabledSigning(bool &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","enabledSigning"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    return getFlag(ENABLED_SIGNING, val);
 }
 
-bool TransientNymiBandInfo::enabledSymmetricKeys(bool &val){
+bool TransientNymiBandInfo::enabledSymmetricKeys(bool &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","enabledSymmetricKeys"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    return getFlag(ENABLED_SYMMETRIC_KEYS, val);
 }
 
-bool TransientNymiBandInfo::enabledTOTP(bool &val){
+bool TransientNymiBandInfo::enabledTOTP(bool &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","enabledTOTP"},jit)){
-        val = jit.value();
-        return true;
-    }
-    return false;
+    return getFlag(ENABLED_TOTP, val);
 }
 
-bool TransientNymiBandInfo::getPid(std::string &val){
+bool TransientNymiBandInfo::getPid(std::string &val) const {
 
-    nljson::iterator jit;
-    if (hasKey(deviceInfo,{"provisioned","pid"},jit)){
-        val = jit.value();
+    if (has & LONG_PID) {
+        val = overflow->pid;
+        return true;
+    }
+    if (has & PID) {
+        val.assign(pid, pidLength);
         return true;
     }
     val = "";
     return false;
-}
\ No newline at end of file
+}
@@ -9,36 +9,90 @@
 #ifndef NymiDeviceInfo_hpp
 #define NymiDeviceInfo_hpp
 
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 #include "json/src/json.hpp"
 #include "NymiApiEnums.h"
 
 using nljson = nlohmann::json;
 
+/*
+    The info napi gave for one band, decoded in one pass when the info response is handled.
+    Fields the response did not have, or had with an unexpected type, read as missing: their getter
+    returns false. Everything is held inline but the command queue, which is usually empty, and a
+    firmware version or pid too long for the inline buffers. Those are shared by the copies of a snapshot.
+ */
 class TransientNymiBandInfo {
     
 public:
     
-    TransientNymiBandInfo(){ /*intentionally empty*/ }
-    TransientNymiBandInfo(nljson &jobj);
+    TransientNymiBandInfo();
+    TransientNymiBandInfo(const nljson &jobj);
     
-    bool getRssiLast(int &val);
-    bool getRssiSmoothed(int &val);
-    bool getFirmwareVersion(std::string &val);
-    bool getFoundState(FoundStatus &val);
-    bool getPresenceState(PresenceStatus &val);
-    bool isProvisioned(bool &val);
-    bool getSinceLastContact(double &val);
-    bool getAuthenticationWindowRemaining(double &val);
-    bool getNumCommandsQueued(int &val);
-    bool getCommandsQueued(std::vector<std::string> &commands);
-    bool enabledRoamingAuthentication(bool &val);
-    bool enabledSigning(bool &val);
-    bool enabledSymmetricKeys(bool &val);
-    bool enabledTOTP(bool &val);
-    bool getPid(std::string &val);
+    bool getRssiLast(int &val) const;
+    bool getRssiSmoothed(int &val) const;
+    bool getFirmwareVersion(std::string &val) const;
+    bool getFoundState(FoundStatus &val) const;
+    bool getPresenceState(PresenceStatus &val) const;
+    bool isProvisioned(bool &val) const;
+    bool getSinceLastContact(double &val) const;
+    bool getAuthenticationWindowRemaining(double &val) const;
+    bool getNumCommandsQueued(int &val) const;
+    bool getCommandsQueued(std::vector<std::string> &commands) const;
+    bool enabledRoamingAuthentication(bool &val) const;
+    bool enabledSigning(bool &val) const;
+    bool enabledSymmetricKeys(bool &val) const;
+    bool enabledTOTP(bool &val) const;
+    bool getPid(std::string &val) const;
   
 private:
-    nljson deviceInfo;
+    
+    //bits of has, for the fields the info had, and of flags, for the values of the bool fields
+    enum Field : std::uint32_t {
+        RSSI_LAST = 1 << 0,
+        RSSI_SMOOTHED = 1 << 1,
+        FIRMWARE_VERSION = 1 << 2,
+        LONG_FIRMWARE_VERSION = 1 << 3,         //in overflow
+        FOUND = 1 << 4,
+        PRESENT = 1 << 5,
+        IS_PROVISIONED = 1 << 6,
+        SINCE_LAST_CONTACT = 1 << 7,
+        AUTHENTICATION_WINDOW_REMAINING = 1 << 8,
+        COMMANDS_QUEUED = 1 << 9,
+        COMMAND_QUEUE = 1 << 10,
+        ENABLED_ROAMING_AUTH_SETUP = 1 << 11,
+        ENABLED_SIGNING = 1 << 12,
+        ENABLED_SYMMETRIC_KEYS = 1 << 13,
+        ENABLED_TOTP = 1 << 14,
+        PID = 1 << 15,
+        LONG_PID = 1 << 16                      //in overflow
+    };
+    
+    struct Overflow {
+        std::vector<std::string> commandQueue;
+        std::string firmwareVersion;
+        std::string pid;
+    };
+    
+    void decodeProvisioned(const nljson::object_t &provisioned, const std::string *&longPid);
+    bool getFlag(Field field, bool &val) const;
+    
+    std::shared_ptr<const Overflow> overflow;   //null unless the command queue is not empty or the firmware version is long
+    double sinceLastContact;
+    double authenticationWindowRemaining;
+    std::int32_t rssiLast;
+    std::int32_t rssiSmoothed;
+    std::int32_t numCommandsQueued;
+    std::uint32_t has;
+    std::uint32_t flags;
+    FoundStatus found;
+    PresenceStatus presence;
+    std::uint8_t firmwareVersionLength;
+    char firmwareVersion[15];
+    std::uint8_t pidLength;
+    char pid[32];                               //napi pids are 32 hex digits
 };
 
 
@@ -0,0 +1,188 @@
+//
+//  WrapperLog.cpp
+//  NapiCpp
+//
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include "WrapperLog.h"
+
+namespace PrivateLog {
+
+    struct Record {
+        WrapperLogLevel level;
+        std::string text;
+    };
+
+    //bounded queue of Dmitry Vyukov's design: a producer claims a cell with one CAS on enqueuePos,
+    //and each cell's sequence number tells producers and the consumer whose turn it is
+    struct Cell {
+        std::atomic<std::size_t> seq;
+        Record record;
+    };
+
+    const std::size_t capacity = 4096;     //power of 2
+    Cell cells[capacity];
+    std::atomic<std::size_t> enqueuePos{ 0 };
+    std::size_t dequeuePos = 0;             //consumer only
+
+    struct CellInit {
+        CellInit() { for (std::size_t i = 0; i < capacity; ++i) cells[i].seq.store(i, std::memory_order_relaxed); }
+    } cellInit;
+
+    std::atomic<int> level{ static_cast<int>(WrapperLogLevel::warning) };
+    std::atomic<std::uint64_t> dropped{ 0 };
+
+    std::mutex sinkMtx;
+    wrapperLogSink sink = nullptr;
+
+    std::atomic<bool> quit{ false };
+    std::atomic<bool> writerIdle{ false };
+    std::mutex wakeMtx;
+    std::condition_variable wakeCv;
+
+    void setLevel(WrapperLogLevel _level) {
+        level.store(static_cast<int>(_level), std::memory_order_relaxed);
+    }
+
+    WrapperLogLevel getLevel() {
+        return static_cast<WrapperLogLevel>(level.load(std::memory_order_relaxed));
+    }
+
+    bool enabled(WrapperLogLevel _level) {
+        return static_cast<int>(_level) <= level.load(std::memory_order_relaxed);
+    }
+
+    void setSink(wrapperLogSink _sink) {
+        std::lock_guard<std::mutex> lock(sinkMtx);
+        sink = _sink;
+    }
+
+    std::uint64_t getDropped() {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void setQuit(bool _quit) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMtx);
+            quit.store(_quit);
+        }
+        wakeCv.notify_one();
+    }
+
+    void write(WrapperLogLevel _level, std::string text) {
+
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & (capacity - 1)];
+            std::size_t seq = cell->seq.load(std::memory_order_acquire);
+            std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);   //full
+                return;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->record.level = _level;
+        cell->record.text = std::move(text);
+        cell->seq.store(pos + 1, std::memory_order_release);
+
+        if (writerIdle.load()) {
+            { std::lock_guard<std::mutex> lock(wakeMtx); }
+            wakeCv.notify_one();
+        }
+    }
+
+    bool take(Record &record) {
+
+        Cell &cell = cells[dequeuePos & (capacity - 1)];
+        if (cell.seq.load(std::memory_order_acquire) != dequeuePos + 1) return false;
+
+        record = std::move(cell.record);
+        cell.seq.store(dequeuePos + capacity, std::memory_order_release);
+        ++dequeuePos;
+        return true;
+    }
+
+    std::string redact(const std::string &text) {
+
+        static const char *secretFields[] = { "\"key\"", "\"totp\"", "\"pseudoRandomNumber\"" };
+
+        std::string out = text;
+        for (const char *field : secretFields) {
+
+            std::size_t fieldLen = std::char_traits<char>::length(field);
+            for (std::size_t at = out.find(field); at != std::string::npos; at = out.find(field, at + 1)) {
+
+                //only string values are secrets, e.g. "totp":true in a delete request is not
+                std::size_t i = at + fieldLen;
+                while (i < out.size() && (out[i] == ' ' || out[i] == '\t')) ++i;
+                if (i >= out.size() || out[i] != ':') continue;
+                ++i;
+                while (i < out.size() && (out[i] == ' ' || out[i] == '\t')) ++i;
+                if (i >= out.size() || out[i] != '"') continue;
+
+                std::size_t end = i + 1;
+                while (end < out.size() && out[end] != '"') end += (out[end] == '\\') ? 2 : 1;
+                if (end >= out.size()) break;
+
+                out.replace(i + 1, end - i - 1, "<redacted>");
+            }
+        }
+        return out;
+    }
+
+    const char *levelName(WrapperLogLevel _level) {
+
+        switch (_level) {
+            case WrapperLogLevel::error: return "error";
+            case WrapperLogLevel::warning: return "warning";
+            case WrapperLogLevel::info: return "info";
+            case WrapperLogLevel::debug: return "debug";
+            case WrapperLogLevel::trace: return "trace";
+            default: return "";
+        }
+    }
+
+    void writeLogs() {
+
+        Record record;
+        while (true) {
+
+            bool wrote = false;
+            {
+                std::lock_guard<std::mutex> lock(sinkMtx);
+                while (take(record)) {
+                    std::string line = redact(record.text);
+                    if (sink) sink(record.level, line);
+                    else std::clog << "[NapiCpp " << levelName(record.level) << "] " << line << '\n';
+                    wrote = true;
+                }
+            }
+            if (wrote) {
+                std::clog.flush();
+                continue;
+            }
+
+            if (quit.load()) break;
+
+            //producers only notify when the writer says it is idle. the timeout covers a record
+            //queued between the check above and the writer going idle
+            std::unique_lock<std::mutex> lock(wakeMtx);
+            writerIdle.store(true);
+            wakeCv.wait_for(lock, std::chrono::milliseconds(100), []{ return quit.load() || cells[dequeuePos & (capacity - 1)].seq.load(std::memory_order_acquire) == dequeuePos + 1; });
+            writerIdle.store(false);
+        }
+    }
+
+} //end namespace PrivateLog
@@ -0,0 +1,60 @@
+//
+//  WrapperLog.h
+//  NapiCpp
+//
+//  Logging for the wrapper's own messages (napi logs separately, see nymi::LogLevel).
+//  Threads only format and queue a record; NymiApi::logWriter writes them out.
+//
+
+#ifndef WrapperLog_h
+#define WrapperLog_h
+
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+
+enum class WrapperLogLevel { error = 0, warning = 1, info = 2, debug = 3, trace = 4 };
+
+//levels above this are compiled out of NAPICPP_LOG. define it lower in release builds, e.g. -DNAPICPP_MAX_LOG_LEVEL=1
+#ifndef NAPICPP_MAX_LOG_LEVEL
+#define NAPICPP_MAX_LOG_LEVEL 3
+#endif
+
+//expr is anything that can be streamed, e.g. NAPICPP_LOG(WrapperLogLevel::debug, "received message: " << message);
+//nothing is evaluated unless level is compiled in and enabled at runtime
+#define NAPICPP_LOG(level, expr) \
+    do { \
+        if (static_cast<int>(level) <= NAPICPP_MAX_LOG_LEVEL && PrivateLog::enabled(level)) { \
+            std::ostringstream napicppLogStream; \
+            napicppLogStream << expr; \
+            PrivateLog::write(level, napicppLogStream.str()); \
+        } \
+    } while (false)
+
+using wrapperLogSink = std::function<void(WrapperLogLevel level, const std::string &line)>;
+
+namespace PrivateLog {
+
+    //runtime level, default warning
+    void setLevel(WrapperLogLevel level);
+    WrapperLogLevel getLevel();
+    bool enabled(WrapperLogLevel level);
+
+    //where records end up, std::clog if not set. called on NymiApi::logWriter only
+    void setSink(wrapperLogSink sink);
+
+    //queues a record without blocking. if the queue is full the record is dropped and counted
+    void write(WrapperLogLevel level, std::string text);
+    std::uint64_t getDropped();
+
+    //values of json fields holding key material, e.g. "key" and "totp", are replaced by "<redacted>"
+    std::string redact(const std::string &text);
+
+    //running on the thread NymiApi::logWriter. on quit, writes what is queued and returns
+    void setQuit(bool _quit);
+    void writeLogs();
+
+} //end namespace PrivateLog
+
+#endif /* WrapperLog_h */